@@ -0,0 +1,727 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
+#include "utils.h"
+#include "aggregate.h"
+
+typedef enum {
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MEAN,
+    AGG_MIN,
+    AGG_MAX
+} rkv_agg_fn_t;
+
+typedef struct rkv_agg_spec {
+    rkv_agg_fn_t fn;
+    char *field;                /* NULL for count */
+    char *name;                 /* name of the result column */
+    rkv_column_t *column;
+} rkv_agg_spec_t;
+
+/* The key of a group is the serialized values of its group fields */
+typedef struct rkv_group {
+    uint64_t hash;
+    size_t keyOffset;
+    size_t keyLen;
+} rkv_group_t;
+
+struct rkv_aggregate {
+    char **by;
+    rkv_column_t **byColumns;
+    int nBy;
+    rkv_agg_spec_t *aggs;
+    int nAggs;
+    rkv_group_t *groups;
+    int nGroups;
+    int groupCapacity;
+    double *values;             /* per group and aggregate: sum, min, max */
+    double *counts;             /* per group and aggregate: values seen */
+    int *slots;                 /* open addressing, group index + 1 */
+    int nSlots;
+    unsigned char *keys;        /* the keys of all the groups */
+    size_t keysLen;
+    size_t keysCapacity;
+    unsigned char *scratch;     /* the key of the current row */
+    size_t scratchLen;
+    size_t scratchCapacity;
+};
+
+static int parseAggregate(const char *expr, const char *name,
+                          rkv_agg_spec_t *spec);
+static char *copyTrimmed(const char *start, const char *end);
+static rkv_error_t reserve(unsigned char **buf, size_t *capacity,
+                           size_t size);
+static rkv_error_t appendKey(rkv_aggregate_t *aggregate, const void *data,
+                             size_t size);
+static rkv_error_t buildKey(rkv_aggregate_t *aggregate, R_xlen_t row);
+static uint64_t hashKey(const unsigned char *key, size_t len);
+static rkv_error_t growSlots(rkv_aggregate_t *aggregate);
+static rkv_error_t addGroup(rkv_aggregate_t *aggregate, uint64_t hash,
+                            int *ret_group);
+static rkv_column_t *findColumn(rkv_frame_t *frame, const char *name);
+
+rkv_error_t rkv_aggregate_create(SEXP by, SEXP aggs,
+                                 rkv_aggregate_t **ret_aggregate,
+                                 int *ret_bad_index) {
+    rkv_aggregate_t *aggregate = NULL;
+    SEXP names;
+    int i;
+    rkv_error_t ret;
+
+    if (!ret_aggregate || (!isNull(by) && !isString(by)) || !isString(aggs)) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    ret = rkv_malloc(sizeof(rkv_aggregate_t), (void**)&aggregate);
+    RETURN_IF_ERR(ret);
+
+    aggregate->nBy = isNull(by) ? 0 : LENGTH(by);
+    if (aggregate->nBy > 0) {
+        ret = rkv_malloc(sizeof(char *) * aggregate->nBy,
+                         (void**)&aggregate->by);
+        CLEANUP_IF_RERR(ret);
+        ret = rkv_malloc(sizeof(rkv_column_t *) * aggregate->nBy,
+                         (void**)&aggregate->byColumns);
+        CLEANUP_IF_RERR(ret);
+    }
+    for (i = 0; i < aggregate->nBy; i++) {
+        if (STRING_ELT(by, i) == NA_STRING) {
+            ret = RKV_INVALID_ARGUEMENTS;
+            goto Cleanup;
+        }
+        if ((aggregate->by[i] = strdup(CHAR(STRING_ELT(by, i)))) == NULL) {
+            ret = RKV_NO_MEMORY;
+            goto Cleanup;
+        }
+    }
+
+    aggregate->nAggs = LENGTH(aggs);
+    if (aggregate->nAggs > 0) {
+        ret = rkv_malloc(sizeof(rkv_agg_spec_t) * aggregate->nAggs,
+                         (void**)&aggregate->aggs);
+        CLEANUP_IF_RERR(ret);
+    }
+    names = getAttrib(aggs, R_NamesSymbol);
+    for (i = 0; i < aggregate->nAggs; i++) {
+        const char *name = NULL;
+
+        if (!isNull(names) && STRING_ELT(names, i) != NA_STRING &&
+            *CHAR(STRING_ELT(names, i)) != '\0') {
+            name = CHAR(STRING_ELT(names, i));
+        }
+        if (STRING_ELT(aggs, i) == NA_STRING ||
+            !parseAggregate(CHAR(STRING_ELT(aggs, i)), name,
+                            &aggregate->aggs[i])) {
+            if (ret_bad_index) {
+                *ret_bad_index = i;
+            }
+            ret = RKV_INVALID_ARGUEMENTS;
+            goto Cleanup;
+        }
+    }
+
+    *ret_aggregate = aggregate;
+    aggregate = NULL;
+
+Cleanup:
+    rkv_aggregate_release(aggregate);
+    return ret;
+}
+
+/* The fields to decode, the group fields then the aggregated ones */
+SEXP rkv_aggregate_fields(const rkv_aggregate_t *aggregate) {
+    SEXP fields;
+    int i, j, n = 0;
+
+    PROTECT(fields = allocVector(STRSXP, aggregate->nBy + aggregate->nAggs));
+    for (i = 0; i < aggregate->nBy + aggregate->nAggs; i++) {
+        const char *field = (i < aggregate->nBy) ? aggregate->by[i] :
+                            aggregate->aggs[i - aggregate->nBy].field;
+
+        if (field == NULL) {
+            continue;
+        }
+        for (j = 0; j < n; j++) {
+            if (strcmp(CHAR(STRING_ELT(fields, j)), field) == 0) {
+                break;
+            }
+        }
+        if (j == n) {
+            SET_STRING_ELT(fields, n++, mkChar(field));
+        }
+    }
+    fields = lengthgets(fields, n);
+    UNPROTECT(1);
+    return fields;
+}
+
+/* Aggregated fields must be numbers or logicals, enums only group */
+rkv_error_t rkv_aggregate_bind(rkv_aggregate_t *aggregate,
+                               rkv_frame_t *frame) {
+    int i;
+
+    if (!aggregate || !frame) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    for (i = 0; i < aggregate->nBy; i++) {
+        aggregate->byColumns[i] = findColumn(frame, aggregate->by[i]);
+        if (aggregate->byColumns[i] == NULL) {
+            return RKV_INVALID_COLUMN;
+        }
+        if (aggregate->byColumns[i]->rtype == VECSXP) {
+            return RKV_INVALID_COLUMN_TYPE;
+        }
+    }
+    for (i = 0; i < aggregate->nAggs; i++) {
+        rkv_agg_spec_t *spec = &aggregate->aggs[i];
+
+        if (spec->field == NULL) {
+            continue;
+        }
+        spec->column = findColumn(frame, spec->field);
+        if (spec->column == NULL) {
+            return RKV_INVALID_COLUMN;
+        }
+        if (spec->column->rtype == STRSXP ||
+            spec->column->rtype == VECSXP ||
+            spec->column->type == AVRO_ENUM) {
+            return RKV_INVALID_COLUMN_TYPE;
+        }
+    }
+    return RKV_SUCCESS;
+}
+
+rkv_error_t rkv_aggregate_add_row(rkv_aggregate_t *aggregate, R_xlen_t row) {
+    uint64_t hash;
+    int i, group = -1, mask;
+    rkv_error_t ret;
+
+    ret = buildKey(aggregate, row);
+    RETURN_IF_ERR(ret);
+    hash = hashKey(aggregate->scratch, aggregate->scratchLen);
+
+    /* Keep the load factor under 0.7 */
+    if ((aggregate->nGroups + 1) * 10 > aggregate->nSlots * 7) {
+        ret = growSlots(aggregate);
+        RETURN_IF_ERR(ret);
+    }
+    mask = aggregate->nSlots - 1;
+    for (i = (int)(hash & mask); aggregate->slots[i] != 0;
+         i = (i + 1) & mask) {
+        rkv_group_t *g = &aggregate->groups[aggregate->slots[i] - 1];
+
+        if (g->hash == hash && g->keyLen == aggregate->scratchLen &&
+            memcmp(aggregate->keys + g->keyOffset, aggregate->scratch,
+                   g->keyLen) == 0) {
+            group = aggregate->slots[i] - 1;
+            break;
+        }
+    }
+    if (group < 0) {
+        ret = addGroup(aggregate, hash, &group);
+        RETURN_IF_ERR(ret);
+        aggregate->slots[i] = group + 1;
+    }
+
+    for (i = 0; i < aggregate->nAggs; i++) {
+        const rkv_agg_spec_t *spec = &aggregate->aggs[i];
+        size_t cell = (size_t)group * aggregate->nAggs + i;
+        double value;
+
+        if (spec->fn == AGG_COUNT) {
+            aggregate->counts[cell]++;
+            continue;
+        }
+        if (spec->column->type == AVRO_INT64) {
+            int64_t i64Value = ((const int64_t *)spec->column->data)[row];
+            if (i64Value == RKV_NA_INTEGER64) {
+                continue;
+            }
+            value = (double)i64Value;
+        } else if (spec->column->rtype == REALSXP) {
+            value = ((const double *)spec->column->data)[row];
+            if (ISNAN(value)) {
+                continue;
+            }
+        } else {
+            int iValue = ((const int *)spec->column->data)[row];
+            if (iValue == NA_INTEGER) {
+                continue;
+            }
+            value = iValue;
+        }
+        switch (spec->fn) {
+        case AGG_MIN:
+            if (value < aggregate->values[cell]) {
+                aggregate->values[cell] = value;
+            }
+            break;
+        case AGG_MAX:
+            if (value > aggregate->values[cell]) {
+                aggregate->values[cell] = value;
+            }
+            break;
+        default:
+            aggregate->values[cell] += value;
+            break;
+        }
+        aggregate->counts[cell]++;
+    }
+    return RKV_SUCCESS;
+}
+
+/*
+ * One row per group in the order they were first seen. Without group
+ * fields there is always one row, with a count of 0 and NA for the other
+ * aggregates if no record was aggregated.
+ */
+SEXP rkv_aggregate_result(const rkv_aggregate_t *aggregate) {
+    SEXP columns, names, column;
+    int nCols = aggregate->nBy + aggregate->nAggs, i, g;
+    int nRows = (aggregate->nBy == 0 && aggregate->nGroups == 0) ?
+                1 : aggregate->nGroups;
+
+    PROTECT(columns = allocVector(VECSXP, nCols));
+    PROTECT(names = allocVector(STRSXP, nCols));
+    for (i = 0; i < aggregate->nBy; i++) {
+        SET_VECTOR_ELT(columns, i, allocVector(aggregate->byColumns[i]->rtype,
+                                               aggregate->nGroups));
+        SET_STRING_ELT(names, i, mkChar(aggregate->by[i]));
+    }
+    for (g = 0; g < aggregate->nGroups; g++) {
+        const unsigned char *p = aggregate->keys +
+                                 aggregate->groups[g].keyOffset;
+
+        for (i = 0; i < aggregate->nBy; i++) {
+            column = VECTOR_ELT(columns, i);
+            switch (TYPEOF(column)) {
+            case INTSXP:
+                memcpy(&INTEGER(column)[g], p, sizeof(int));
+                p += sizeof(int);
+                break;
+            case LGLSXP:
+                memcpy(&LOGICAL(column)[g], p, sizeof(int));
+                p += sizeof(int);
+                break;
+            case REALSXP:
+                memcpy(&REAL(column)[g], p, sizeof(double));
+                p += sizeof(double);
+                break;
+            case STRSXP: {
+                int len;
+
+                if (*p++ == 0) {
+                    SET_STRING_ELT(column, g, NA_STRING);
+                    break;
+                }
+                memcpy(&len, p, sizeof(int));
+                p += sizeof(int);
+                SET_STRING_ELT(column, g,
+                               mkCharLenCE((const char *)p, len, CE_UTF8));
+                p += len;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+    for (i = 0; i < aggregate->nBy; i++) {
+        finishFrameColumn(aggregate->byColumns[i], VECTOR_ELT(columns, i));
+    }
+
+    for (i = 0; i < aggregate->nAggs; i++) {
+        const rkv_agg_spec_t *spec = &aggregate->aggs[i];
+
+        column = allocVector(REALSXP, nRows);
+        SET_VECTOR_ELT(columns, aggregate->nBy + i, column);
+        SET_STRING_ELT(names, aggregate->nBy + i, mkChar(spec->name));
+        for (g = 0; g < nRows; g++) {
+            size_t cell = (size_t)g * aggregate->nAggs + i;
+            double count;
+
+            if (g >= aggregate->nGroups) {
+                REAL(column)[g] = (spec->fn == AGG_COUNT) ? 0 : NA_REAL;
+                continue;
+            }
+            count = aggregate->counts[cell];
+            switch (spec->fn) {
+            case AGG_COUNT:
+                REAL(column)[g] = count;
+                break;
+            case AGG_SUM:
+                REAL(column)[g] = aggregate->values[cell];
+                break;
+            case AGG_MEAN:
+                REAL(column)[g] = (count > 0) ?
+                                  aggregate->values[cell] / count : NA_REAL;
+                break;
+            default:
+                REAL(column)[g] = (count > 0) ?
+                                  aggregate->values[cell] : NA_REAL;
+                break;
+            }
+        }
+    }
+
+    columns = makeDataFrame(columns, names, nRows);
+    UNPROTECT(2);
+    return columns;
+}
+
+void rkv_aggregate_release(rkv_aggregate_t *aggregate) {
+    int i;
+
+    if (aggregate == NULL) {
+        return;
+    }
+    for (i = 0; aggregate->by != NULL && i < aggregate->nBy; i++) {
+        free(aggregate->by[i]);
+    }
+    free(aggregate->by);
+    free(aggregate->byColumns);
+    for (i = 0; aggregate->aggs != NULL && i < aggregate->nAggs; i++) {
+        free(aggregate->aggs[i].field);
+        free(aggregate->aggs[i].name);
+    }
+    free(aggregate->aggs);
+    free(aggregate->groups);
+    free(aggregate->values);
+    free(aggregate->counts);
+    free(aggregate->slots);
+    free(aggregate->keys);
+    free(aggregate->scratch);
+    free(aggregate);
+}
+
+/* "count", "count()" or "fn(field)", the default name is "fn_field" */
+static int parseAggregate(const char *expr, const char *name,
+                          rkv_agg_spec_t *spec) {
+    static const struct {
+        const char *name;
+        rkv_agg_fn_t fn;
+    } fns[] = {
+        {"count", AGG_COUNT}, {"sum", AGG_SUM}, {"mean", AGG_MEAN},
+        {"min", AGG_MIN}, {"max", AGG_MAX}
+    };
+    const char *open, *close, *end = expr + strlen(expr);
+    char *fn = NULL, *field = NULL;
+    size_t i;
+    int ok = 0;
+
+    open = strchr(expr, '(');
+    if (open == NULL) {
+        fn = copyTrimmed(expr, end);
+    } else {
+        close = strrchr(open, ')');
+        if (close == NULL) {
+            return 0;
+        }
+        for (i = 1; close + i < end; i++) {
+            if (!isspace((unsigned char)close[i])) {
+                return 0;
+            }
+        }
+        fn = copyTrimmed(expr, open);
+        field = copyTrimmed(open + 1, close);
+    }
+    if (fn == NULL || (open != NULL && field == NULL)) {
+        goto Cleanup;
+    }
+    if (field != NULL && *field == '\0') {
+        free(field);
+        field = NULL;
+    }
+
+    memset(spec, 0, sizeof(rkv_agg_spec_t));
+    for (i = 0; i < sizeof(fns) / sizeof(fns[0]); i++) {
+        if (strcmp(fn, fns[i].name) == 0) {
+            spec->fn = fns[i].fn;
+            break;
+        }
+    }
+    if (i == sizeof(fns) / sizeof(fns[0]) ||
+        (spec->fn == AGG_COUNT) != (field == NULL)) {
+        goto Cleanup;
+    }
+
+    if (name != NULL) {
+        spec->name = strdup(name);
+    } else if (field == NULL) {
+        spec->name = strdup(fn);
+    } else if ((spec->name = malloc(strlen(fn) + strlen(field) + 2))) {
+        sprintf(spec->name, "%s_%s", fn, field);
+    }
+    if (spec->name == NULL) {
+        goto Cleanup;
+    }
+    spec->field = field;
+    field = NULL;
+    ok = 1;
+
+Cleanup:
+    free(fn);
+    free(field);
+    return ok;
+}
+
+static char *copyTrimmed(const char *start, const char *end) {
+    char *copy;
+
+    while (start < end && isspace((unsigned char)*start)) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    if ((copy = malloc(end - start + 1)) != NULL) {
+        memcpy(copy, start, end - start);
+        copy[end - start] = '\0';
+    }
+    return copy;
+}
+
+static rkv_error_t reserve(unsigned char **buf, size_t *capacity,
+                           size_t size) {
+    size_t newCapacity = *capacity ? *capacity : 64;
+    unsigned char *newBuf;
+
+    if (size <= *capacity) {
+        return RKV_SUCCESS;
+    }
+    while (newCapacity < size) {
+        newCapacity *= 2;
+    }
+    if ((newBuf = realloc(*buf, newCapacity)) == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    *buf = newBuf;
+    *capacity = newCapacity;
+    return RKV_SUCCESS;
+}
+
+static rkv_error_t appendKey(rkv_aggregate_t *aggregate, const void *data,
+                             size_t size) {
+    rkv_error_t ret;
+
+    ret = reserve(&aggregate->scratch, &aggregate->scratchCapacity,
+                  aggregate->scratchLen + size);
+    RETURN_IF_ERR(ret);
+    memcpy(aggregate->scratch + aggregate->scratchLen, data, size);
+    aggregate->scratchLen += size;
+    return RKV_SUCCESS;
+}
+
+/*
+ * Serializes the group values of a row: ints and logicals as 4 bytes,
+ * doubles and longs as 8 bytes and strings as a NA flag, a length and
+ * the bytes.
+ */
+static rkv_error_t buildKey(rkv_aggregate_t *aggregate, R_xlen_t row) {
+    int i;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    aggregate->scratchLen = 0;
+    for (i = 0; i < aggregate->nBy && ret == RKV_SUCCESS; i++) {
+        const rkv_column_t *column = aggregate->byColumns[i];
+
+        switch (column->rtype) {
+        case INTSXP:
+        case LGLSXP:
+            ret = appendKey(aggregate, &((const int *)column->data)[row],
+                            sizeof(int));
+            break;
+        case REALSXP: {
+            double value = ((const double *)column->data)[row];
+
+            /* The int64_t of a long column are copied as they are */
+            if (column->type == AVRO_INT64) {
+                ret = appendKey(aggregate,
+                                &((const int64_t *)column->data)[row],
+                                sizeof(int64_t));
+                break;
+            }
+            /* NaN payloads and signed zeros must hash alike */
+            if (ISNAN(value)) {
+                value = R_IsNA(value) ? NA_REAL : R_NaN;
+            } else if (value == 0) {
+                value = 0;
+            }
+            ret = appendKey(aggregate, &value, sizeof(double));
+            break;
+        }
+        case STRSXP: {
+            SEXP value = STRING_ELT(column->vector, row);
+            unsigned char isSet = (value != NA_STRING);
+            int len;
+
+            ret = appendKey(aggregate, &isSet, 1);
+            if (isSet && ret == RKV_SUCCESS) {
+                len = LENGTH(value);
+                ret = appendKey(aggregate, &len, sizeof(int));
+                if (ret == RKV_SUCCESS) {
+                    ret = appendKey(aggregate, CHAR(value), len);
+                }
+            }
+            break;
+        }
+        default:
+            ret = RKV_INVALID_COLUMN_TYPE;
+            break;
+        }
+    }
+    return ret;
+}
+
+/* FNV-1a */
+static uint64_t hashKey(const unsigned char *key, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static rkv_error_t growSlots(rkv_aggregate_t *aggregate) {
+    int nSlots = aggregate->nSlots ? aggregate->nSlots * 2 : 64;
+    int *slots, g, i, mask = nSlots - 1;
+
+    if ((slots = calloc(nSlots, sizeof(int))) == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    for (g = 0; g < aggregate->nGroups; g++) {
+        for (i = (int)(aggregate->groups[g].hash & mask); slots[i] != 0;
+             i = (i + 1) & mask) {
+        }
+        slots[i] = g + 1;
+    }
+    free(aggregate->slots);
+    aggregate->slots = slots;
+    aggregate->nSlots = nSlots;
+    return RKV_SUCCESS;
+}
+
+/* Adds the group of the key in scratch */
+static rkv_error_t addGroup(rkv_aggregate_t *aggregate, uint64_t hash,
+                            int *ret_group) {
+    rkv_group_t *group;
+    int i, g = aggregate->nGroups;
+    rkv_error_t ret;
+
+    if (g == aggregate->groupCapacity) {
+        int capacity = g ? g * 2 : 64;
+        size_t cells = (size_t)capacity * aggregate->nAggs;
+        void *p;
+
+        if ((p = realloc(aggregate->groups,
+                         sizeof(rkv_group_t) * capacity)) == NULL) {
+            return RKV_NO_MEMORY;
+        }
+        aggregate->groups = p;
+        if (cells > 0) {
+            if ((p = realloc(aggregate->values,
+                             sizeof(double) * cells)) == NULL) {
+                return RKV_NO_MEMORY;
+            }
+            aggregate->values = p;
+            if ((p = realloc(aggregate->counts,
+                             sizeof(double) * cells)) == NULL) {
+                return RKV_NO_MEMORY;
+            }
+            aggregate->counts = p;
+        }
+        aggregate->groupCapacity = capacity;
+    }
+
+    ret = reserve(&aggregate->keys, &aggregate->keysCapacity,
+                  aggregate->keysLen + aggregate->scratchLen);
+    RETURN_IF_ERR(ret);
+    if (aggregate->scratchLen > 0) {
+        memcpy(aggregate->keys + aggregate->keysLen, aggregate->scratch,
+               aggregate->scratchLen);
+    }
+
+    group = &aggregate->groups[g];
+    group->hash = hash;
+    group->keyOffset = aggregate->keysLen;
+    group->keyLen = aggregate->scratchLen;
+    aggregate->keysLen += aggregate->scratchLen;
+
+    for (i = 0; i < aggregate->nAggs; i++) {
+        size_t cell = (size_t)g * aggregate->nAggs + i;
+
+        aggregate->counts[cell] = 0;
+        switch (aggregate->aggs[i].fn) {
+        case AGG_MIN:
+            aggregate->values[cell] = R_PosInf;
+            break;
+        case AGG_MAX:
+            aggregate->values[cell] = R_NegInf;
+            break;
+        default:
+            aggregate->values[cell] = 0;
+            break;
+        }
+    }
+    aggregate->nGroups++;
+    *ret_group = g;
+    return RKV_SUCCESS;
+}
+
+static rkv_column_t *findColumn(rkv_frame_t *frame, const char *name) {
+    int i;
+
+    for (i = 0; i < frame->nColumns; i++) {
+        if (strcmp(frame->columns[i].name, name) == 0) {
+            return &frame->columns[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,71 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include <Rinternals.h>
+#include "rkverr.h"
+#include "dataframe.h"
+
+/*
+ * Grouped aggregates of the rows decoded into a frame. The groups are
+ * kept in a hash table keyed by the values of the group fields, so the
+ * memory used follows the number of groups and not the number of rows.
+ * The aggregates are "count", "sum(field)", "mean(field)", "min(field)"
+ * and "max(field)", NA values are ignored.
+ */
+typedef struct rkv_aggregate rkv_aggregate_t;
+
+rkv_error_t rkv_aggregate_create(SEXP by, SEXP aggs,
+                                 rkv_aggregate_t **ret_aggregate,
+                                 int *ret_bad_index);
+SEXP rkv_aggregate_fields(const rkv_aggregate_t *aggregate);
+rkv_error_t rkv_aggregate_bind(rkv_aggregate_t *aggregate,
+                               rkv_frame_t *frame);
+rkv_error_t rkv_aggregate_add_row(rkv_aggregate_t *aggregate, R_xlen_t row);
+SEXP rkv_aggregate_result(const rkv_aggregate_t *aggregate);
+void rkv_aggregate_release(rkv_aggregate_t *aggregate);
+
+#endif
@@ -0,0 +1,628 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+#include <string.h>
+
+#include "utils.h"
+#include "avrodecode.h"
+
+/*
+ * The value of an avro record in the store is the sorted packed integer
+ * id of its writer schema followed by the avro binary encoding of the
+ * record. A plan maps each field of one writer schema to the column it
+ * is decoded into, or to the steps of its fields for a nested record,
+ * fields without a column are skipped. When the writer schema does not
+ * line up with the columns (a missing field, a promoted type), the plan
+ * is not direct and the caller falls back to the generic avro values
+ * which resolve the schemas.
+ */
+typedef struct rkv_decode_step {
+    avro_schema_t schema;       /* writer schema of the field */
+    avro_schema_t valueSchema;  /* the same, a nullable union unwrapped */
+    avro_type_t type;           /* of valueSchema */
+    int nullBranch;             /* -1 if the field is not a nullable union */
+    rkv_column_t *column;       /* NULL when the field is skipped */
+    struct rkv_decode_step *fields; /* nested record with columns */
+    int nFields;
+} rkv_decode_step_t;
+
+struct rkv_decode_plan {
+    avro_schema_t writer;
+    unsigned char schemaId[RKV_SCHEMA_ID_MAX]; /* as encoded in the values */
+    int schemaIdSize;
+    int isDirect;
+    rkv_decode_step_t *steps;
+    int nSteps;
+};
+
+typedef struct rkv_reader {
+    const unsigned char *p;
+    const unsigned char *end;
+} rkv_reader_t;
+
+static rkv_error_t createSteps(avro_schema_t record, const char *prefix,
+                               int depth, rkv_column_t *columns,
+                               int nColumns, rkv_decode_step_t **ret_steps,
+                               int *ret_nSteps, int *nMatched,
+                               int *isDirect);
+static void releaseSteps(rkv_decode_step_t *steps, int nSteps);
+static int isSameType(const rkv_column_t *column,
+                      const rkv_decode_step_t *step);
+static int decodeSteps(rkv_reader_t *reader, const rkv_decode_step_t *steps,
+                       int nSteps, R_xlen_t row);
+static int decodeValue(rkv_reader_t *reader, const rkv_decode_step_t *step,
+                       R_xlen_t row);
+static void setStepNA(const rkv_decode_step_t *step, R_xlen_t row);
+static rkv_column_t *findColumn(rkv_column_t *columns, int nColumns,
+                                const char *name);
+static int skipSchemaId(rkv_reader_t *reader);
+static int skipBytes(rkv_reader_t *reader, int64_t size);
+static int readLong(rkv_reader_t *reader, int64_t *ret_value);
+static int readFloat(rkv_reader_t *reader, double *ret_value);
+static int readDouble(rkv_reader_t *reader, double *ret_value);
+static int skipBlocks(rkv_reader_t *reader, avro_schema_t items, int isMap);
+static int skipValue(rkv_reader_t *reader, avro_schema_t schema);
+
+/*
+ * The size of the schema id that prefixes a value, -1 if the value is too
+ * short. Values written with the same schema start with the same bytes.
+ */
+int rkv_decode_schema_id_size(const unsigned char *data, size_t size) {
+    rkv_reader_t reader;
+
+    if (!data) {
+        return -1;
+    }
+    reader.p = data;
+    reader.end = data + size;
+    if (skipSchemaId(&reader) != 0) {
+        return -1;
+    }
+    return (int)(reader.p - data);
+}
+
+/* The plan of the writer schema whose id is schemaId */
+rkv_error_t rkv_decode_plan_create(avro_schema_t writer,
+                                   const unsigned char *schemaId,
+                                   int schemaIdSize,
+                                   rkv_column_t *columns,
+                                   int nColumns,
+                                   rkv_decode_plan_t **ret_plan) {
+    rkv_decode_plan_t *plan = NULL;
+    int nMatched = 0, isDirect = 1;
+    rkv_error_t ret;
+
+    if (!schemaId || schemaIdSize <= 0 ||
+        schemaIdSize > RKV_SCHEMA_ID_MAX || !ret_plan) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    ret = rkv_malloc(sizeof(rkv_decode_plan_t), (void**)&plan);
+    RETURN_IF_ERR(ret);
+    memcpy(plan->schemaId, schemaId, schemaIdSize);
+    plan->schemaIdSize = schemaIdSize;
+    *ret_plan = plan;
+
+    /* Without a writer, the plan only records that the id can't be read */
+    if (writer == NULL) {
+        return RKV_SUCCESS;
+    }
+    plan->writer = avro_schema_incref(writer);
+    if (avro_typeof(writer) != AVRO_RECORD) {
+        return RKV_SUCCESS;
+    }
+    ret = createSteps(writer, NULL, 0, columns, nColumns, &plan->steps,
+                      &plan->nSteps, &nMatched, &isDirect);
+    if (ret != RKV_SUCCESS) {
+        rkv_decode_plan_release(plan);
+        *ret_plan = NULL;
+        return ret;
+    }
+    plan->isDirect = isDirect && (nMatched == nColumns);
+    return RKV_SUCCESS;
+}
+
+/* Whether the value prefixed with this schema id is written with the plan */
+int rkv_decode_plan_has_id(const rkv_decode_plan_t *plan,
+                           const unsigned char *schemaId, int schemaIdSize) {
+    return plan->schemaIdSize == schemaIdSize &&
+           memcmp(plan->schemaId, schemaId, schemaIdSize) == 0;
+}
+
+int rkv_decode_plan_is_direct(const rkv_decode_plan_t *plan) {
+    return plan->isDirect;
+}
+
+int rkv_decode_plan_has_writer(const rkv_decode_plan_t *plan) {
+    return plan->writer != NULL;
+}
+
+/*
+ * Decode one record into the given row of the columns. On failure the
+ * row may be partially written, the caller does not count it.
+ */
+rkv_error_t rkv_decode_record(const rkv_decode_plan_t *plan,
+                              const unsigned char *data,
+                              size_t size,
+                              R_xlen_t row) {
+    rkv_reader_t reader;
+
+    if (!plan || !plan->isDirect || !data) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    reader.p = data;
+    reader.end = data + size;
+    if (skipSchemaId(&reader) != 0 ||
+        decodeSteps(&reader, plan->steps, plan->nSteps, row) != 0) {
+        return RKV_VALUE_NOT_AVRO;
+    }
+    return RKV_SUCCESS;
+}
+
+void rkv_decode_plan_release(rkv_decode_plan_t *plan) {
+    if (plan == NULL) {
+        return;
+    }
+    releaseSteps(plan->steps, plan->nSteps);
+    if (plan->writer != NULL) {
+        avro_schema_decref(plan->writer);
+    }
+    free(plan);
+}
+
+/*
+ * The steps of the fields of a writer record, the columns of nested
+ * records are named with the dotted path of their field.
+ */
+static rkv_error_t createSteps(avro_schema_t record, const char *prefix,
+                               int depth, rkv_column_t *columns,
+                               int nColumns, rkv_decode_step_t **ret_steps,
+                               int *ret_nSteps, int *nMatched,
+                               int *isDirect) {
+    rkv_decode_step_t *steps = NULL;
+    int i, nSteps = avro_schema_record_size(record);
+    rkv_error_t ret = RKV_SUCCESS;
+
+    *ret_steps = NULL;
+    *ret_nSteps = 0;
+    if (nSteps == 0) {
+        return RKV_SUCCESS;
+    }
+    ret = rkv_malloc(sizeof(rkv_decode_step_t) * nSteps, (void**)&steps);
+    RETURN_IF_ERR(ret);
+
+    for (i = 0; i < nSteps && ret == RKV_SUCCESS; i++) {
+        rkv_decode_step_t *step = &steps[i];
+        const char *fieldName = avro_schema_record_field_name(record, i);
+        char *name;
+
+        step->schema = avro_schema_record_field_get_by_index(record, i);
+        step->valueSchema = unwrapNullable(step->schema, &step->nullBranch);
+        step->type = avro_typeof(step->valueSchema);
+
+        name = malloc((prefix ? strlen(prefix) + 1 : 0) +
+                      strlen(fieldName) + 1);
+        if (name == NULL) {
+            ret = RKV_NO_MEMORY;
+            break;
+        }
+        if (prefix != NULL) {
+            sprintf(name, "%s.%s", prefix, fieldName);
+        } else {
+            strcpy(name, fieldName);
+        }
+
+        if (step->type == AVRO_RECORD && depth + 1 < RKV_FRAME_MAX_DEPTH) {
+            int nNested = 0;
+
+            ret = createSteps(step->valueSchema, name, depth + 1, columns,
+                              nColumns, &step->fields, &step->nFields,
+                              &nNested, isDirect);
+            if (nNested == 0) {
+                releaseSteps(step->fields, step->nFields);
+                step->fields = NULL;
+                step->nFields = 0;
+            }
+            *nMatched += nNested;
+        } else {
+            step->column = findColumn(columns, nColumns, name);
+            if (step->column != NULL) {
+                if (!isSameType(step->column, step)) {
+                    *isDirect = 0;
+                }
+                (*nMatched)++;
+            }
+        }
+        free(name);
+    }
+    if (ret != RKV_SUCCESS) {
+        releaseSteps(steps, nSteps);
+        return ret;
+    }
+    *ret_steps = steps;
+    *ret_nSteps = nSteps;
+    return RKV_SUCCESS;
+}
+
+static void releaseSteps(rkv_decode_step_t *steps, int nSteps) {
+    int i;
+
+    if (steps == NULL) {
+        return;
+    }
+    for (i = 0; i < nSteps; i++) {
+        releaseSteps(steps[i].fields, steps[i].nFields);
+    }
+    free(steps);
+}
+
+/* Enums must have the same symbols in the same order */
+static int isSameType(const rkv_column_t *column,
+                      const rkv_decode_step_t *step) {
+    if (column->type != step->type) {
+        return 0;
+    }
+    if (step->type == AVRO_ENUM) {
+        return avro_schema_equal(column->schema, step->valueSchema);
+    }
+    return 1;
+}
+
+static int decodeSteps(rkv_reader_t *reader, const rkv_decode_step_t *steps,
+                       int nSteps, R_xlen_t row) {
+    int64_t branch;
+    int i;
+
+    for (i = 0; i < nSteps; i++) {
+        const rkv_decode_step_t *step = &steps[i];
+
+        if (step->column == NULL && step->fields == NULL) {
+            if (skipValue(reader, step->schema) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (step->nullBranch >= 0) {
+            if (readLong(reader, &branch) != 0 || branch < 0 || branch > 1) {
+                return -1;
+            }
+            if (branch == step->nullBranch) {
+                setStepNA(step, row);
+                continue;
+            }
+        }
+        if (step->fields != NULL) {
+            if (decodeSteps(reader, step->fields, step->nFields, row) != 0) {
+                return -1;
+            }
+        } else if (decodeValue(reader, step, row) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int decodeValue(rkv_reader_t *reader, const rkv_decode_step_t *step,
+                       R_xlen_t row) {
+    rkv_column_t *col = step->column;
+    int64_t lValue;
+    int err = 0;
+
+    switch (step->type) {
+    case AVRO_INT32:
+        err = readLong(reader, &lValue);
+        if (err == 0 && (lValue < INT32_MIN || lValue > INT32_MAX)) {
+            err = -1;
+        }
+        ((int *)col->data)[row] = (int)lValue;
+        break;
+    case AVRO_INT64:
+        err = readLong(reader, &((int64_t *)col->data)[row]);
+        break;
+    case AVRO_FLOAT:
+        err = readFloat(reader, &((double *)col->data)[row]);
+        break;
+    case AVRO_DOUBLE:
+        err = readDouble(reader, &((double *)col->data)[row]);
+        break;
+    case AVRO_BOOLEAN:
+        if (reader->p >= reader->end) {
+            err = -1;
+            break;
+        }
+        ((int *)col->data)[row] = (*reader->p++ != 0);
+        break;
+    case AVRO_ENUM:
+        err = readLong(reader, &lValue);
+        if (err == 0 && (lValue < 0 || lValue >=
+                avro_schema_enum_number_of_symbols(step->valueSchema))) {
+            err = -1;
+        }
+        /* Factor codes start at 1 */
+        ((int *)col->data)[row] = (int)lValue + 1;
+        break;
+    case AVRO_STRING: {
+        const char *str, *nul;
+
+        err = readLong(reader, &lValue);
+        if (err != 0) {
+            break;
+        }
+        str = (const char *)reader->p;
+        err = skipBytes(reader, lValue);
+        if (err != 0) {
+            break;
+        }
+        /* Same as the generic path, the string stops at a NUL */
+        nul = memchr(str, '\0', (size_t)lValue);
+        if (nul != NULL) {
+            lValue = nul - str;
+        }
+        SET_STRING_ELT(col->vector, row, mkCharLenCE(str, (int)lValue,
+                                                     CE_UTF8));
+        break;
+    }
+    case AVRO_BYTES:
+    case AVRO_FIXED: {
+        const unsigned char *bytes;
+        SEXP raw;
+
+        if (step->type == AVRO_BYTES) {
+            err = readLong(reader, &lValue);
+        } else {
+            lValue = avro_schema_fixed_size(step->valueSchema);
+        }
+        if (err != 0) {
+            break;
+        }
+        bytes = reader->p;
+        err = skipBytes(reader, lValue);
+        if (err != 0) {
+            break;
+        }
+        raw = allocVector(RAWSXP, (R_xlen_t)lValue);
+        SET_VECTOR_ELT(col->vector, row, raw);
+        if (lValue > 0) {
+            memcpy(RAW(raw), bytes, (size_t)lValue);
+        }
+        break;
+    }
+    default:
+        err = -1;
+        break;
+    }
+    return err;
+}
+
+/* A null nested record is NA in all of its columns */
+static void setStepNA(const rkv_decode_step_t *step, R_xlen_t row) {
+    int i;
+
+    if (step->column != NULL) {
+        setFrameColumnNA(step->column, row);
+    }
+    for (i = 0; i < step->nFields; i++) {
+        setStepNA(&step->fields[i], row);
+    }
+}
+
+static rkv_column_t *findColumn(rkv_column_t *columns, int nColumns,
+                                const char *name) {
+    int i;
+
+    for (i = 0; i < nColumns; i++) {
+        if (strcmp(columns[i].name, name) == 0) {
+            return &columns[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * A sorted packed integer is a single byte in 0x08..0xF7, otherwise the
+ * first byte tells the number of bytes that follow it.
+ */
+static int skipSchemaId(rkv_reader_t *reader) {
+    int b;
+
+    if (reader->p >= reader->end) {
+        return -1;
+    }
+    b = *reader->p++;
+    if (b < 0x08) {
+        return skipBytes(reader, 0x08 - b);
+    } else if (b > 0xF7) {
+        return skipBytes(reader, b - 0xF7);
+    }
+    return 0;
+}
+
+static int skipBytes(rkv_reader_t *reader, int64_t size) {
+    if (size < 0 || size > reader->end - reader->p) {
+        return -1;
+    }
+    reader->p += size;
+    return 0;
+}
+
+/* Zig-zag varint, values below 64 in magnitude take the first branch */
+static int readLong(rkv_reader_t *reader, int64_t *ret_value) {
+    const unsigned char *p = reader->p;
+    uint64_t value;
+    int shift;
+
+    if (p < reader->end && !(*p & 0x80)) {
+        value = *p++;
+    } else {
+        value = 0;
+        shift = 0;
+        do {
+            if (p >= reader->end || shift > 63) {
+                return -1;
+            }
+            value |= (uint64_t)(*p & 0x7F) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+    }
+    reader->p = p;
+    *ret_value = (int64_t)((value >> 1) ^ (~(value & 1) + 1));
+    return 0;
+}
+
+/* Little endian IEEE 754, assembled bytewise to be host independent */
+static int readFloat(rkv_reader_t *reader, double *ret_value) {
+    const unsigned char *p = reader->p;
+    uint32_t bits = 0;
+    float value;
+    int i;
+
+    if (reader->end - p < 4) {
+        return -1;
+    }
+    for (i = 3; i >= 0; i--) {
+        bits = (bits << 8) | p[i];
+    }
+    memcpy(&value, &bits, sizeof(float));
+    *ret_value = value;
+    reader->p = p + 4;
+    return 0;
+}
+
+static int readDouble(rkv_reader_t *reader, double *ret_value) {
+    const unsigned char *p = reader->p;
+    uint64_t bits = 0;
+    int i;
+
+    if (reader->end - p < 8) {
+        return -1;
+    }
+    for (i = 7; i >= 0; i--) {
+        bits = (bits << 8) | p[i];
+    }
+    memcpy(ret_value, &bits, sizeof(double));
+    reader->p = p + 8;
+    return 0;
+}
+
+static int skipBlocks(rkv_reader_t *reader, avro_schema_t items, int isMap) {
+    int64_t count, i, size;
+
+    for (;;) {
+        if (readLong(reader, &count) != 0) {
+            return -1;
+        }
+        if (count == 0) {
+            return 0;
+        }
+        /* A negative count is followed by the block size in bytes */
+        if (count < 0) {
+            if (readLong(reader, &size) != 0 ||
+                skipBytes(reader, size) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            if (isMap) {
+                if (readLong(reader, &size) != 0 ||
+                    skipBytes(reader, size) != 0) {
+                    return -1;
+                }
+            }
+            if (skipValue(reader, items) != 0) {
+                return -1;
+            }
+        }
+    }
+}
+
+static int skipValue(rkv_reader_t *reader, avro_schema_t schema) {
+    int64_t value;
+    size_t i, n;
+
+    switch (avro_typeof(schema)) {
+    case AVRO_NULL:
+        return 0;
+    case AVRO_BOOLEAN:
+        return skipBytes(reader, 1);
+    case AVRO_INT32:
+    case AVRO_INT64:
+    case AVRO_ENUM:
+        return readLong(reader, &value);
+    case AVRO_FLOAT:
+        return skipBytes(reader, 4);
+    case AVRO_DOUBLE:
+        return skipBytes(reader, 8);
+    case AVRO_STRING:
+    case AVRO_BYTES:
+        if (readLong(reader, &value) != 0) {
+            return -1;
+        }
+        return skipBytes(reader, value);
+    case AVRO_FIXED:
+        return skipBytes(reader, avro_schema_fixed_size(schema));
+    case AVRO_RECORD:
+        n = avro_schema_record_size(schema);
+        for (i = 0; i < n; i++) {
+            if (skipValue(reader,
+                    avro_schema_record_field_get_by_index(schema, i)) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    case AVRO_UNION:
+        if (readLong(reader, &value) != 0 || value < 0 ||
+            (size_t)value >= avro_schema_union_size(schema)) {
+            return -1;
+        }
+        return skipValue(reader, avro_schema_union_branch(schema, value));
+    case AVRO_ARRAY:
+        return skipBlocks(reader, avro_schema_array_items(schema), 0);
+    case AVRO_MAP:
+        return skipBlocks(reader, avro_schema_map_values(schema), 1);
+    case AVRO_LINK:
+        return skipValue(reader, avro_schema_link_target(schema));
+    default:
+        return -1;
+    }
+}
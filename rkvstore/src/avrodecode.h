@@ -0,0 +1,79 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#ifndef __AVRODECODE_H__
+#define __AVRODECODE_H__
+
+#include <kvstore.h>
+#include "rkverr.h"
+#include "dataframe.h"
+
+/*
+ * Decodes the avro binary encoding of records written with one writer
+ * schema straight into the columns of a frame, without building generic
+ * avro values.
+ */
+typedef struct rkv_decode_plan rkv_decode_plan_t;
+
+/* The schema id is a sorted packed integer of at most 9 bytes */
+#define RKV_SCHEMA_ID_MAX   9
+
+int rkv_decode_schema_id_size(const unsigned char *data, size_t size);
+rkv_error_t rkv_decode_plan_create(avro_schema_t writer,
+                                   const unsigned char *schemaId,
+                                   int schemaIdSize,
+                                   rkv_column_t *columns,
+                                   int nColumns,
+                                   rkv_decode_plan_t **ret_plan);
+int rkv_decode_plan_has_id(const rkv_decode_plan_t *plan,
+                           const unsigned char *schemaId, int schemaIdSize);
+int rkv_decode_plan_is_direct(const rkv_decode_plan_t *plan);
+int rkv_decode_plan_has_writer(const rkv_decode_plan_t *plan);
+rkv_error_t rkv_decode_record(const rkv_decode_plan_t *plan,
+                              const unsigned char *data,
+                              size_t size,
+                              R_xlen_t row);
+void rkv_decode_plan_release(rkv_decode_plan_t *plan);
+
+#endif
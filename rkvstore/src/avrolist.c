@@ -0,0 +1,276 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+#include <string.h>
+
+#include "utils.h"
+#include "symbols.h"
+#include "avrolist.h"
+
+static rkv_error_t toR(const avro_value_t *value, int integer64,
+                       SEXP *ret_obj);
+static rkv_error_t recordToR(const avro_value_t *value, int integer64,
+                             SEXP *ret_obj);
+static rkv_error_t collectionToR(const avro_value_t *value, int isMap,
+                                 int integer64, SEXP *ret_obj);
+static rkv_error_t setAtomic(const avro_value_t *value, SEXP vector,
+                             R_xlen_t index, int integer64);
+static SEXPTYPE atomicType(avro_type_t type);
+static avro_schema_t resolveSchema(avro_schema_t schema);
+
+rkv_error_t rkv_avro_to_r(const avro_value_t *value, SEXP *ret_obj) {
+    return toR(value, useInteger64(), ret_obj);
+}
+
+static rkv_error_t toR(const avro_value_t *value, int integer64,
+                       SEXP *ret_obj) {
+    avro_value_t branch;
+    const void *buf = NULL;
+    size_t size = 0;
+    avro_type_t type = avro_value_get_type(value);
+    SEXP obj;
+    rkv_error_t ret;
+    int err;
+
+    switch (type) {
+    case AVRO_NULL:
+        *ret_obj = R_NilValue;
+        return RKV_SUCCESS;
+    case AVRO_BYTES:
+    case AVRO_FIXED:
+        err = (type == AVRO_BYTES) ? avro_value_get_bytes(value, &buf, &size) :
+                                     avro_value_get_fixed(value, &buf, &size);
+        if (err != 0) {
+            return RKV_INVALID_AVRO_SET_OP;
+        }
+        *ret_obj = allocVector(RAWSXP, size);
+        if (size > 0) {
+            memcpy(RAW(*ret_obj), buf, size);
+        }
+        return RKV_SUCCESS;
+    case AVRO_RECORD:
+        return recordToR(value, integer64, ret_obj);
+    case AVRO_ARRAY:
+    case AVRO_MAP:
+        return collectionToR(value, type == AVRO_MAP, integer64, ret_obj);
+    case AVRO_UNION:
+        if (avro_value_get_current_branch(value, &branch) != 0) {
+            return RKV_INVALID_AVRO_SET_OP;
+        }
+        return toR(&branch, integer64, ret_obj);
+    default:
+        if (atomicType(type) == VECSXP) {
+            return RKV_INVALID_COLUMN_TYPE;
+        }
+        PROTECT(obj = allocVector(atomicType(type), 1));
+        ret = setAtomic(value, obj, 0, integer64);
+        if (type == AVRO_INT64 && integer64) {
+            classgets(obj, cls_integer64);
+        }
+        UNPROTECT(1);
+        *ret_obj = obj;
+        return ret;
+    }
+}
+
+static rkv_error_t recordToR(const avro_value_t *value, int integer64,
+                             SEXP *ret_obj) {
+    avro_value_t field;
+    const char *name = NULL;
+    size_t size = 0, i;
+    SEXP list, names, elt;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    if (avro_value_get_size(value, &size) != 0) {
+        return RKV_INVALID_AVRO_SET_OP;
+    }
+    PROTECT(list = allocVector(VECSXP, size));
+    PROTECT(names = allocVector(STRSXP, size));
+    for (i = 0; i < size && ret == RKV_SUCCESS; i++) {
+        if (avro_value_get_by_index(value, i, &field, &name) != 0) {
+            ret = RKV_INVALID_AVRO_SET_OP;
+            break;
+        }
+        ret = toR(&field, integer64, &elt);
+        if (ret == RKV_SUCCESS) {
+            SET_VECTOR_ELT(list, i, elt);
+            SET_STRING_ELT(names, i, mkCharCE(name, CE_UTF8));
+        }
+    }
+    setAttrib(list, R_NamesSymbol, names);
+    UNPROTECT(2);
+    *ret_obj = list;
+    return ret;
+}
+
+/* Arrays and maps of a primitive or enum type become atomic vectors */
+static rkv_error_t collectionToR(const avro_value_t *value, int isMap,
+                                 int integer64, SEXP *ret_obj) {
+    avro_schema_t schema, items;
+    avro_value_t item;
+    const char *name = NULL;
+    size_t size = 0, i;
+    SEXPTYPE rtype;
+    SEXP vector, names = R_NilValue, elt;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    schema = resolveSchema(avro_value_get_schema(value));
+    items = resolveSchema(isMap ? avro_schema_map_values(schema) :
+                                  avro_schema_array_items(schema));
+    rtype = atomicType(avro_typeof(items));
+    if (avro_value_get_size(value, &size) != 0) {
+        return RKV_INVALID_AVRO_SET_OP;
+    }
+
+    PROTECT(vector = allocVector(rtype, size));
+    if (avro_typeof(items) == AVRO_INT64 && integer64) {
+        classgets(vector, cls_integer64);
+    }
+    if (isMap) {
+        names = allocVector(STRSXP, size);
+        setAttrib(vector, R_NamesSymbol, names);
+    }
+    for (i = 0; i < size && ret == RKV_SUCCESS; i++) {
+        if (avro_value_get_by_index(value, i, &item, &name) != 0) {
+            ret = RKV_INVALID_AVRO_SET_OP;
+            break;
+        }
+        if (rtype == VECSXP) {
+            ret = toR(&item, integer64, &elt);
+            if (ret == RKV_SUCCESS) {
+                SET_VECTOR_ELT(vector, i, elt);
+            }
+        } else {
+            ret = setAtomic(&item, vector, i, integer64);
+        }
+        if (isMap) {
+            SET_STRING_ELT(names, i, mkCharCE(name, CE_UTF8));
+        }
+    }
+    UNPROTECT(1);
+    *ret_obj = vector;
+    return ret;
+}
+
+/* Longs are the int64_t as is in an integer64 vector, doubles otherwise */
+static rkv_error_t setAtomic(const avro_value_t *value, SEXP vector,
+                             R_xlen_t index, int integer64) {
+    const char *str = NULL;
+    size_t size = 0;
+    int64_t i64Value;
+    float fValue;
+    int err;
+
+    switch (avro_value_get_type(value)) {
+    case AVRO_INT32:
+        err = avro_value_get_int(value, &INTEGER(vector)[index]);
+        break;
+    case AVRO_INT64:
+        err = avro_value_get_long(value, &i64Value);
+        if (integer64) {
+            memcpy(&REAL(vector)[index], &i64Value, sizeof(int64_t));
+        } else {
+            REAL(vector)[index] = (double)i64Value;
+        }
+        break;
+    case AVRO_FLOAT:
+        err = avro_value_get_float(value, &fValue);
+        REAL(vector)[index] = fValue;
+        break;
+    case AVRO_DOUBLE:
+        err = avro_value_get_double(value, &REAL(vector)[index]);
+        break;
+    case AVRO_BOOLEAN:
+        err = avro_value_get_boolean(value, &LOGICAL(vector)[index]);
+        break;
+    case AVRO_STRING:
+        /* The size of an avro string counts its NUL terminator */
+        err = avro_value_get_string(value, &str, &size);
+        if (err == 0) {
+            SET_STRING_ELT(vector, index,
+                           mkCharLenCE(str, size > 0 ? (int)size - 1 : 0,
+                                       CE_UTF8));
+        }
+        break;
+    case AVRO_ENUM: {
+        avro_schema_t schema = resolveSchema(avro_value_get_schema(value));
+        int symbol;
+
+        err = avro_value_get_enum(value, &symbol);
+        if (err == 0) {
+            str = avro_schema_enum_get(schema, symbol);
+            SET_STRING_ELT(vector, index,
+                           str ? mkCharCE(str, CE_UTF8) : NA_STRING);
+        }
+        break;
+    }
+    default:
+        return RKV_INVALID_COLUMN_TYPE;
+    }
+    return (err != 0) ? RKV_INVALID_AVRO_SET_OP : RKV_SUCCESS;
+}
+
+static SEXPTYPE atomicType(avro_type_t type) {
+    switch (type) {
+    case AVRO_INT32:
+        return INTSXP;
+    case AVRO_INT64:
+    case AVRO_FLOAT:
+    case AVRO_DOUBLE:
+        return REALSXP;
+    case AVRO_BOOLEAN:
+        return LGLSXP;
+    case AVRO_STRING:
+    case AVRO_ENUM:
+        return STRSXP;
+    default:
+        return VECSXP;
+    }
+}
+
+static avro_schema_t resolveSchema(avro_schema_t schema) {
+    while (schema != NULL && avro_typeof(schema) == AVRO_LINK) {
+        schema = avro_schema_link_target(schema);
+    }
+    return schema;
+}
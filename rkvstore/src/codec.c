@@ -0,0 +1,404 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "utils.h"
+#include "codec.h"
+
+#define CODEC_MIN_CAPACITY      4096
+
+static const unsigned char codecMagic[4] = {0, 'R', 'K', 'Z'};
+static const unsigned char manifestMagic[4] = {0, 'R', 'K', 'L'};
+
+struct rkv_codec_writer {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    size_t threshold;           /* size from which the data is deflated */
+    int compress;
+    size_t rawSize;             /* bytes written before compression */
+    z_stream zs;
+};
+
+struct rkv_codec_reader {
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    int compressed;
+    size_t rawSize;             /* size of the data after inflating */
+    z_stream zs;
+};
+
+static rkv_error_t reserve(rkv_codec_writer_t *writer, size_t size);
+static void putBigEndian(unsigned char *buf, size_t value, int nBytes);
+static size_t getBigEndian(const unsigned char *buf, int nBytes);
+static rkv_error_t deflateInput(rkv_codec_writer_t *writer, int flush);
+static rkv_error_t startDeflate(rkv_codec_writer_t *writer);
+
+rkv_error_t rkv_codec_writer_create(size_t threshold,
+                                    rkv_codec_writer_t **ret_writer) {
+    rkv_codec_writer_t *writer;
+    rkv_error_t ret;
+
+    if (!ret_writer) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    if ((writer = calloc(1, sizeof(rkv_codec_writer_t))) == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    writer->threshold = threshold;
+    ret = reserve(writer, CODEC_MIN_CAPACITY);
+    if (ret != RKV_SUCCESS) {
+        rkv_codec_writer_release(writer);
+        return ret;
+    }
+    *ret_writer = writer;
+    return RKV_SUCCESS;
+}
+
+rkv_error_t rkv_codec_write(rkv_codec_writer_t *writer,
+                            const void *data, size_t size) {
+    rkv_error_t ret;
+
+    /* Switch before the data is copied, so it is never buffered as is */
+    if (!writer->compress && writer->threshold > 0 &&
+        writer->size + size >= writer->threshold) {
+        ret = startDeflate(writer);
+        RETURN_IF_ERR(ret);
+    }
+    if (!writer->compress) {
+        ret = reserve(writer, writer->size + size);
+        RETURN_IF_ERR(ret);
+        memcpy(writer->data + writer->size, data, size);
+        writer->size += size;
+        return RKV_SUCCESS;
+    }
+    writer->rawSize += size;
+    writer->zs.next_in = (Bytef *)data;
+    writer->zs.avail_in = (uInt)size;
+    return deflateInput(writer, Z_NO_FLUSH);
+}
+
+rkv_error_t rkv_codec_writer_finish(rkv_codec_writer_t *writer,
+                                    const unsigned char **ret_data,
+                                    size_t *ret_size) {
+    rkv_error_t ret;
+    int i;
+
+    if (writer->compress) {
+        if (writer->rawSize > RKV_CODEC_MAX_RAW_SIZE) {
+            return RKV_VALUE_OUT_OF_RANGE;
+        }
+        writer->zs.avail_in = 0;
+        ret = deflateInput(writer, Z_FINISH);
+        RETURN_IF_ERR(ret);
+        for (i = 0; i < 4; i++) {
+            writer->data[4 + i] =
+                (unsigned char)(writer->rawSize >> (8 * (3 - i)));
+        }
+    }
+    *ret_data = writer->data;
+    *ret_size = writer->size;
+    return RKV_SUCCESS;
+}
+
+int rkv_codec_writer_grew(const rkv_codec_writer_t *writer) {
+    return writer->compress && writer->size >= writer->rawSize;
+}
+
+void rkv_codec_writer_release(rkv_codec_writer_t *writer) {
+    if (writer == NULL) {
+        return;
+    }
+    if (writer->compress) {
+        deflateEnd(&writer->zs);
+    }
+    free(writer->data);
+    free(writer);
+}
+
+rkv_error_t rkv_codec_reader_create(const unsigned char *data, size_t size,
+                                    rkv_codec_reader_t **ret_reader) {
+    rkv_codec_reader_t *reader;
+
+    if (!ret_reader || (!data && size > 0)) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    if ((reader = calloc(1, sizeof(rkv_codec_reader_t))) == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    reader->data = data;
+    reader->size = size;
+    if (rkv_codec_is_compressed(data, size)) {
+        reader->rawSize = rkv_codec_raw_size(data, size);
+        reader->zs.next_in = (Bytef *)data + RKV_CODEC_HEADER_SIZE;
+        reader->zs.avail_in = (uInt)(size - RKV_CODEC_HEADER_SIZE);
+        if (inflateInit(&reader->zs) != Z_OK) {
+            free(reader);
+            return RKV_NO_MEMORY;
+        }
+        reader->compressed = 1;
+    }
+    *ret_reader = reader;
+    return RKV_SUCCESS;
+}
+
+rkv_error_t rkv_codec_read(rkv_codec_reader_t *reader, void *data,
+                           size_t size) {
+    int err;
+
+    if (!reader->compressed) {
+        if (size > reader->size - reader->pos) {
+            return RKV_CORRUPT_VALUE;
+        }
+        memcpy(data, reader->data + reader->pos, size);
+        reader->pos += size;
+        return RKV_SUCCESS;
+    }
+    if (size > reader->rawSize - reader->pos) {
+        return RKV_CORRUPT_VALUE;
+    }
+    reader->zs.next_out = (Bytef *)data;
+    reader->zs.avail_out = (uInt)size;
+    while (reader->zs.avail_out > 0) {
+        err = inflate(&reader->zs, Z_NO_FLUSH);
+        if (err == Z_MEM_ERROR) {
+            return RKV_NO_MEMORY;
+        }
+        if (err != Z_OK && !(err == Z_STREAM_END &&
+                             reader->zs.avail_out == 0)) {
+            return RKV_CORRUPT_VALUE;
+        }
+    }
+    reader->pos += size;
+    return RKV_SUCCESS;
+}
+
+void rkv_codec_reader_release(rkv_codec_reader_t *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    if (reader->compressed) {
+        inflateEnd(&reader->zs);
+    }
+    free(reader);
+}
+
+int rkv_codec_is_compressed(const unsigned char *data, size_t size) {
+    size_t rawSize;
+
+    if (size < RKV_CODEC_HEADER_SIZE ||
+        memcmp(data, codecMagic, sizeof(codecMagic)) != 0) {
+        return 0;
+    }
+    rawSize = getBigEndian(data + 4, 4);
+    return rawSize <= RKV_CODEC_MAX_RAW_SIZE &&
+           rawSize / RKV_CODEC_MAX_RATIO <= size - RKV_CODEC_HEADER_SIZE;
+}
+
+/* The size of the data once inflated, the size of the data if it is not */
+size_t rkv_codec_raw_size(const unsigned char *data, size_t size) {
+    if (!rkv_codec_is_compressed(data, size)) {
+        return size;
+    }
+    return getBigEndian(data + 4, 4);
+}
+
+rkv_error_t rkv_codec_compress(const unsigned char *data, size_t size,
+                               unsigned char **ret_data, size_t *ret_size) {
+    rkv_codec_writer_t *writer = NULL;
+    const unsigned char *buf;
+    rkv_error_t ret;
+
+    if (!ret_data || !ret_size) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    ret = rkv_codec_writer_create(1, &writer);
+    RETURN_IF_ERR(ret);
+    ret = rkv_codec_write(writer, data, size);
+    if (ret == RKV_SUCCESS) {
+        ret = rkv_codec_writer_finish(writer, &buf, ret_size);
+    }
+    if (ret == RKV_SUCCESS) {
+        /* the buffer is handed over to the caller */
+        *ret_data = writer->data;
+        writer->data = NULL;
+    }
+    rkv_codec_writer_release(writer);
+    return ret;
+}
+
+/* raw has room for rkv_codec_raw_size() bytes */
+rkv_error_t rkv_codec_decompress(const unsigned char *data, size_t size,
+                                 unsigned char *raw) {
+    rkv_codec_reader_t *reader = NULL;
+    rkv_error_t ret;
+
+    ret = rkv_codec_reader_create(data, size, &reader);
+    RETURN_IF_ERR(ret);
+    ret = rkv_codec_read(reader, raw, rkv_codec_raw_size(data, size));
+    rkv_codec_reader_release(reader);
+    return ret;
+}
+
+static rkv_error_t reserve(rkv_codec_writer_t *writer, size_t size) {
+    size_t capacity = writer->capacity ? writer->capacity :
+                      CODEC_MIN_CAPACITY;
+    unsigned char *data;
+
+    if (size <= writer->capacity) {
+        return RKV_SUCCESS;
+    }
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if ((data = realloc(writer->data, capacity)) == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    writer->data = data;
+    writer->capacity = capacity;
+    return RKV_SUCCESS;
+}
+
+/* Deflate the data written so far into a new buffer behind the header */
+static rkv_error_t startDeflate(rkv_codec_writer_t *writer) {
+    unsigned char *data = writer->data;
+    size_t size = writer->size;
+    rkv_error_t ret;
+
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+    ret = reserve(writer, CODEC_MIN_CAPACITY);
+    if (ret != RKV_SUCCESS) {
+        free(data);
+        return ret;
+    }
+    if (deflateInit(&writer->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        free(data);
+        return RKV_NO_MEMORY;
+    }
+    /* the header is completed when the writer is finished */
+    memcpy(writer->data, codecMagic, sizeof(codecMagic));
+    writer->size = RKV_CODEC_HEADER_SIZE;
+    writer->compress = 1;
+    writer->rawSize = size;
+    writer->zs.next_in = (Bytef *)data;
+    writer->zs.avail_in = (uInt)size;
+    ret = deflateInput(writer, Z_NO_FLUSH);
+    free(data);
+    return ret;
+}
+
+/* Deflate the pending input, with Z_FINISH until the end of the stream */
+static rkv_error_t deflateInput(rkv_codec_writer_t *writer, int flush) {
+    rkv_error_t ret;
+    int err;
+
+    for (;;) {
+        if (writer->capacity - writer->size < CODEC_MIN_CAPACITY) {
+            ret = reserve(writer, writer->capacity + 1);
+            RETURN_IF_ERR(ret);
+        }
+        writer->zs.next_out = writer->data + writer->size;
+        writer->zs.avail_out = (uInt)(writer->capacity - writer->size);
+        err = deflate(&writer->zs, flush);
+        writer->size = writer->capacity - writer->zs.avail_out;
+        if (err == Z_STREAM_ERROR) {
+            return RKV_ERROR;
+        }
+        if (flush == Z_FINISH ? err == Z_STREAM_END :
+            (writer->zs.avail_in == 0 && writer->zs.avail_out > 0)) {
+            return RKV_SUCCESS;
+        }
+    }
+}
+
+void rkv_codec_write_manifest(const rkv_lob_manifest_t *manifest,
+                              unsigned char *buf) {
+    memcpy(buf, manifestMagic, sizeof(manifestMagic));
+    putBigEndian(buf + 4, manifest->size, 8);
+    putBigEndian(buf + 12, (size_t)manifest->chunkSize, 4);
+    putBigEndian(buf + 16, (size_t)manifest->nChunks, 4);
+    putBigEndian(buf + 20, (size_t)manifest->generation, 4);
+}
+
+/* RKV_VALUE_NOT_LOB if it is not a manifest, or an inconsistent one */
+rkv_error_t rkv_codec_read_manifest(const unsigned char *data, size_t size,
+                                    rkv_lob_manifest_t *manifest) {
+    if (size != RKV_CODEC_MANIFEST_SIZE ||
+        memcmp(data, manifestMagic, sizeof(manifestMagic)) != 0) {
+        return RKV_VALUE_NOT_LOB;
+    }
+    manifest->size = getBigEndian(data + 4, 8);
+    manifest->chunkSize = (int)getBigEndian(data + 12, 4);
+    manifest->nChunks = (int)getBigEndian(data + 16, 4);
+    manifest->generation = (unsigned int)getBigEndian(data + 20, 4);
+    if (manifest->chunkSize <= 0 || manifest->nChunks < 0 ||
+        (size_t)manifest->nChunks != (manifest->size +
+            manifest->chunkSize - 1) / manifest->chunkSize) {
+        return RKV_CORRUPT_VALUE;
+    }
+    return RKV_SUCCESS;
+}
+
+static void putBigEndian(unsigned char *buf, size_t value, int nBytes) {
+    int i;
+
+    for (i = nBytes - 1; i >= 0; i--) {
+        buf[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+static size_t getBigEndian(const unsigned char *buf, int nBytes) {
+    size_t value = 0;
+    int i;
+
+    for (i = 0; i < nBytes; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
@@ -0,0 +1,122 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#include <stddef.h>
+#include "rkverr.h"
+
+/*
+ * Value codec. A compressed value starts with a header: the magic bytes
+ * "\0RKZ" and the size of the uncompressed data as a 4 bytes big-endian
+ * integer, followed by the zlib stream. Other values are stored as is.
+ */
+#define RKV_CODEC_HEADER_SIZE   8
+
+/*
+ * The header is recognized by its content only, so a raw value that happens
+ * to start with the magic bytes is taken as compressed only if its size is
+ * one deflate could have produced: at most RKV_CODEC_MAX_RATIO times the
+ * zlib stream and never more than RKV_CODEC_MAX_RAW_SIZE.
+ */
+#define RKV_CODEC_MAX_RATIO     1032
+#define RKV_CODEC_MAX_RAW_SIZE  ((size_t)1 << 30)
+
+/* Values smaller than this are not worth compressing */
+#define RKV_CODEC_DEFAULT_THRESHOLD     2048
+
+typedef struct rkv_codec_writer rkv_codec_writer_t;
+typedef struct rkv_codec_reader rkv_codec_reader_t;
+
+/*
+ * Writers append to a buffer they own. With a threshold, the data is
+ * deflated as it is written once it reaches that size, 0 never deflates.
+ */
+rkv_error_t rkv_codec_writer_create(size_t threshold,
+                                    rkv_codec_writer_t **ret_writer);
+rkv_error_t rkv_codec_write(rkv_codec_writer_t *writer,
+                            const void *data, size_t size);
+rkv_error_t rkv_codec_writer_finish(rkv_codec_writer_t *writer,
+                                    const unsigned char **ret_data,
+                                    size_t *ret_size);
+/* Whether the finished data was deflated without getting smaller */
+int rkv_codec_writer_grew(const rkv_codec_writer_t *writer);
+void rkv_codec_writer_release(rkv_codec_writer_t *writer);
+
+/* Readers read the data of a value, inflating it if it is compressed */
+rkv_error_t rkv_codec_reader_create(const unsigned char *data, size_t size,
+                                    rkv_codec_reader_t **ret_reader);
+rkv_error_t rkv_codec_read(rkv_codec_reader_t *reader, void *data,
+                           size_t size);
+void rkv_codec_reader_release(rkv_codec_reader_t *reader);
+
+int rkv_codec_is_compressed(const unsigned char *data, size_t size);
+size_t rkv_codec_raw_size(const unsigned char *data, size_t size);
+
+/* Whole buffer helpers, the compressed data is freed by the caller */
+rkv_error_t rkv_codec_compress(const unsigned char *data, size_t size,
+                               unsigned char **ret_data, size_t *ret_size);
+rkv_error_t rkv_codec_decompress(const unsigned char *data, size_t size,
+                                 unsigned char *raw);
+
+/*
+ * Large object manifest, stored at the key of the object: the magic bytes
+ * "\0RKL", the size of the object as a 8 bytes big-endian integer, then
+ * the chunk size, the number of chunks and the generation of the chunks as
+ * 4 bytes big-endian integers.
+ */
+#define RKV_CODEC_MANIFEST_SIZE     24
+
+typedef struct rkv_lob_manifest {
+    size_t size;
+    int chunkSize;
+    int nChunks;
+    unsigned int generation;    /* each put writes its chunks apart */
+} rkv_lob_manifest_t;
+
+void rkv_codec_write_manifest(const rkv_lob_manifest_t *manifest,
+                              unsigned char *buf);
+rkv_error_t rkv_codec_read_manifest(const unsigned char *data, size_t size,
+                                    rkv_lob_manifest_t *manifest);
+
+#endif
@@ -0,0 +1,1128 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#include "utils.h"
+#include "symbols.h"
+#include "rkvstore_internal.h"
+#include "dataframe.h"
+#include "avrodecode.h"
+#include "filter.h"
+
+static SEXP getDataFrameColumn(SEXP df, SEXP names, const char *name);
+static int isEncodableColumn(avro_type_t type, SEXP column);
+static int isInFieldRange(avro_type_t type, double value);
+static int isColumnInFieldRange(avro_type_t type, SEXP column);
+static SEXP addFilterFields(SEXP columns, const rkv_filter_t *filter);
+static rkv_error_t addFlatFields(avro_schema_t record, const char *prefix,
+                                 int *path, int depth,
+                                 rkv_avro_field **fields, int *nFields,
+                                 int *capacity);
+static rkv_error_t fillFrameRow(rkv_frame_t *frame, avro_value_t *record);
+static int getFieldValue(const rkv_column_t *col, const avro_value_t *record,
+                         avro_value_t *ret_value);
+static void *getVectorData(SEXP vector);
+static size_t getElementSize(SEXPTYPE rtype);
+static rkv_error_t growFrame(rkv_frame_t *frame);
+static rkv_decode_plan_t *getDecodePlan(rkv_frame_t *frame,
+                                        const kv_value_t *value);
+
+rkv_error_t getAvroSchemaFields(const avro_schema_t schema,
+                                rkv_avro_field ** ret_avro_fields,
+                                int * ret_field_size) {
+
+    int i, col_size = avro_schema_record_size(schema);
+    rkv_avro_field * fields = NULL, *pFields;
+
+    rkv_malloc(sizeof(rkv_avro_field) * col_size, (void**)&fields);
+    if (fields == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    pFields = fields;
+    for (i = 0; i < col_size; i++) {
+        pFields->name = strdup(avro_schema_record_field_name(schema, i));
+        pFields->type =
+            avro_typeof(avro_schema_record_field_get_by_index(schema, i));
+        pFields->index = i;
+        pFields++;
+	}
+    if (ret_avro_fields) {
+        *ret_avro_fields = fields;
+    }
+    if (ret_field_size) {
+        *ret_field_size = col_size;
+    }
+    return RKV_SUCCESS;
+}
+
+/*
+ * Keep the fields named in columns, in the order of columns. Unknown or
+ * repeated names fail with RKV_INVALID_COLUMN, R_NilValue keeps them all.
+ */
+rkv_error_t filterAvroSchemaFields(rkv_avro_field **fields, int *nFields,
+                                   SEXP columns) {
+    rkv_avro_field *selected = NULL;
+    int i, j, nSelected;
+    rkv_error_t ret;
+
+    if (isNull(columns)) {
+        return RKV_SUCCESS;
+    }
+    if (!isString(columns)) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    nSelected = LENGTH(columns);
+    if (nSelected == 0) {
+        release_avro_fields(*fields, *nFields);
+        *fields = NULL;
+        *nFields = 0;
+        return RKV_SUCCESS;
+    }
+
+    ret = rkv_malloc(sizeof(rkv_avro_field) * nSelected, (void**)&selected);
+    RETURN_IF_ERR(ret);
+    for (i = 0; i < nSelected; i++) {
+        SEXP column = STRING_ELT(columns, i);
+
+        for (j = 0; j < *nFields; j++) {
+            if (column != NA_STRING && (*fields)[j].name != NULL &&
+                strcmp((*fields)[j].name, CHAR(column)) == 0) {
+                break;
+            }
+        }
+        if (j == *nFields) {
+            release_avro_fields(selected, i);
+            return RKV_INVALID_COLUMN;
+        }
+        selected[i] = (*fields)[j];
+        (*fields)[j].name = NULL;
+        (*fields)[j].path = NULL;
+    }
+    release_avro_fields(*fields, *nFields);
+    *fields = selected;
+    *nFields = nSelected;
+    return RKV_SUCCESS;
+}
+
+void release_avro_fields (rkv_avro_field *fields, int nFields) {
+    int i;
+    for (i = 0; i < nFields; i++) {
+        if (fields[i].name) {
+            free(fields[i].name);
+        }
+        free(fields[i].path);
+    }
+    free(fields);
+}
+
+/*
+ * The fields of the record and of its nested records, with dotted names.
+ * The type of a union of null and one type is that type.
+ */
+rkv_error_t getFlatSchemaFields(const avro_schema_t schema,
+                                rkv_avro_field **ret_avro_fields,
+                                int *ret_field_size) {
+    rkv_avro_field *fields = NULL;
+    int path[RKV_FRAME_MAX_DEPTH];
+    int nFields = 0, capacity = 0;
+    rkv_error_t ret;
+
+    ret = addFlatFields(schema, NULL, path, 0, &fields, &nFields, &capacity);
+    if (ret != RKV_SUCCESS) {
+        release_avro_fields(fields, nFields);
+        return ret;
+    }
+    *ret_avro_fields = fields;
+    *ret_field_size = nFields;
+    return RKV_SUCCESS;
+}
+
+static rkv_error_t addFlatFields(avro_schema_t record, const char *prefix,
+                                 int *path, int depth,
+                                 rkv_avro_field **fields, int *nFields,
+                                 int *capacity) {
+    int i, size = avro_schema_record_size(record);
+    rkv_error_t ret;
+
+    for (i = 0; i < size; i++) {
+        const char *fieldName = avro_schema_record_field_name(record, i);
+        avro_schema_t schema;
+        rkv_avro_field *field;
+        char *name;
+
+        schema = unwrapNullable(
+            avro_schema_record_field_get_by_index(record, i), NULL);
+        name = malloc((prefix ? strlen(prefix) + 1 : 0) +
+                      strlen(fieldName) + 1);
+        if (name == NULL) {
+            return RKV_NO_MEMORY;
+        }
+        if (prefix != NULL) {
+            sprintf(name, "%s.%s", prefix, fieldName);
+        } else {
+            strcpy(name, fieldName);
+        }
+        path[depth] = i;
+
+        if (avro_typeof(schema) == AVRO_RECORD &&
+            depth + 1 < RKV_FRAME_MAX_DEPTH) {
+            ret = addFlatFields(schema, name, path, depth + 1,
+                                fields, nFields, capacity);
+            free(name);
+            RETURN_IF_ERR(ret);
+            continue;
+        }
+
+        if (*nFields == *capacity) {
+            int newCapacity = (*capacity > 0) ? *capacity * 2 : 16;
+            rkv_avro_field *newFields;
+
+            newFields = realloc(*fields, newCapacity * sizeof(rkv_avro_field));
+            if (newFields == NULL) {
+                free(name);
+                return RKV_NO_MEMORY;
+            }
+            *fields = newFields;
+            *capacity = newCapacity;
+        }
+        field = &(*fields)[(*nFields)++];
+        field->name = name;
+        field->type = avro_typeof(schema);
+        field->index = path[0];
+        field->depth = depth + 1;
+        field->schema = schema;
+        field->path = malloc(field->depth * sizeof(int));
+        if (field->path == NULL) {
+            return RKV_NO_MEMORY;
+        }
+        memcpy(field->path, path, field->depth * sizeof(int));
+    }
+    return RKV_SUCCESS;
+}
+
+/*
+ * The schema of the values of a union of null and one other type, and
+ * the index of its null branch. Other schemas are returned as they are,
+ * with -1 as null branch. Links are resolved.
+ */
+avro_schema_t unwrapNullable(avro_schema_t schema, int *ret_null_branch) {
+    int nullBranch = -1;
+
+    while (avro_typeof(schema) == AVRO_LINK) {
+        schema = avro_schema_link_target(schema);
+    }
+    if (avro_typeof(schema) == AVRO_UNION &&
+        avro_schema_union_size(schema) == 2) {
+        if (avro_typeof(avro_schema_union_branch(schema, 0)) == AVRO_NULL) {
+            nullBranch = 0;
+        } else if (avro_typeof(avro_schema_union_branch(schema, 1)) ==
+                   AVRO_NULL) {
+            nullBranch = 1;
+        }
+        if (nullBranch >= 0) {
+            schema = avro_schema_union_branch(schema, 1 - nullBranch);
+            while (avro_typeof(schema) == AVRO_LINK) {
+                schema = avro_schema_link_target(schema);
+            }
+        }
+    }
+    if (ret_null_branch) {
+        *ret_null_branch = nullBranch;
+    }
+    return schema;
+}
+
+/*
+ * Allocate one column per supported record field, nested records being
+ * flattened, or per field named in columns if it is not R_NilValue, the
+ * other fields are never decoded.
+ * The fields the filter uses are added after them as hidden columns. The
+ * columns are filled with appendFrameValue() and turned into a data frame
+ * by frameToDataFrame().
+ */
+rkv_error_t createFrame(const avro_schema_t schema, SEXP columns,
+                        rkv_filter_t *filter, R_xlen_t capacity,
+                        rkv_frame_t **ret_frame) {
+    rkv_frame_t *frame = NULL;
+    rkv_avro_field *fields = NULL;
+    int i, nFields = 0, nVisible = -1, pc = 0;
+    rkv_error_t ret;
+
+    if (!schema || capacity < 0 || !ret_frame) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    if (filter != NULL && !isNull(columns)) {
+        nVisible = LENGTH(columns);
+        PROTECT(columns = addFilterFields(columns, filter));
+        pc++;
+    }
+
+    ret = getFlatSchemaFields(schema, &fields, &nFields);
+    CLEANUP_IF_RERR(ret);
+    ret = filterAvroSchemaFields(&fields, &nFields, columns);
+    CLEANUP_IF_RERR(ret);
+
+    ret = rkv_malloc(sizeof(rkv_frame_t), (void**)&frame);
+    CLEANUP_IF_RERR(ret);
+    ret = rkv_malloc(sizeof(rkv_column_t) * (nFields + 1),
+                     (void**)&frame->columns);
+    CLEANUP_IF_RERR(ret);
+
+    frame->vectors = allocVector(VECSXP, nFields);
+    R_PreserveObject(frame->vectors);
+    frame->capacity = capacity;
+    frame->schema = avro_schema_incref(schema);
+
+    for (i = 0; i < nFields; i++) {
+        rkv_column_t *col = &frame->columns[frame->nColumns];
+        SEXPTYPE rtype;
+
+        switch (fields[i].type) {
+        case AVRO_INT32:
+        case AVRO_ENUM:
+            rtype = INTSXP;
+            break;
+        case AVRO_INT64:
+        case AVRO_FLOAT:
+        case AVRO_DOUBLE:
+            rtype = REALSXP;
+            break;
+        case AVRO_STRING:
+            rtype = STRSXP;
+            break;
+        case AVRO_BOOLEAN:
+            rtype = LGLSXP;
+            break;
+        case AVRO_BYTES:
+        case AVRO_FIXED:
+            rtype = VECSXP;
+            break;
+        default:
+            if (!isNull(columns)) {
+                ret = RKV_INVALID_COLUMN;
+                goto Cleanup;
+            }
+            continue;
+        }
+        col->name = fields[i].name;
+        fields[i].name = NULL;
+        col->type = fields[i].type;
+        col->path = fields[i].path;
+        fields[i].path = NULL;
+        col->depth = fields[i].depth;
+        col->schema = fields[i].schema;
+        col->rtype = rtype;
+        if (rtype == STRSXP || rtype == VECSXP) {
+            col->vector = allocVector(rtype, capacity);
+            SET_VECTOR_ELT(frame->vectors, frame->nColumns, col->vector);
+        } else if (capacity > 0) {
+            col->data = malloc(capacity * getElementSize(rtype));
+            if (col->data == NULL) {
+                ret = RKV_NO_MEMORY;
+                goto Cleanup;
+            }
+        }
+        frame->nColumns++;
+    }
+
+    frame->nVisible = (nVisible >= 0) ? nVisible : frame->nColumns;
+    if (filter != NULL) {
+        ret = rkv_filter_bind(filter, frame->columns, frame->nColumns);
+        CLEANUP_IF_RERR(ret);
+        frame->filter = filter;
+    }
+
+    *ret_frame = frame;
+    frame = NULL;
+
+Cleanup:
+    if (frame != NULL) {
+        releaseFrame(frame);
+    }
+    release_avro_fields(fields, nFields);
+    UNPROTECT(pc);
+    return ret;
+}
+
+rkv_error_t appendFrameRow(rkv_frame_t *frame, avro_value_t *record) {
+    rkv_error_t ret;
+
+    if (!frame || !record) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    if (frame->nRows >= frame->capacity) {
+        ret = growFrame(frame);
+        RETURN_IF_ERR(ret);
+    }
+    ret = fillFrameRow(frame, record);
+    RETURN_IF_ERR(ret);
+    frame->nRows++;
+    return RKV_SUCCESS;
+}
+
+/* Decode the record into the row after the last one, it is not counted */
+static rkv_error_t fillFrameRow(rkv_frame_t *frame, avro_value_t *record) {
+    R_xlen_t iRow;
+    int iCol, err = 0;
+
+    iRow = frame->nRows;
+    for (iCol = 0; iCol < frame->nColumns; iCol++) {
+        rkv_column_t *col = &frame->columns[iCol];
+        avro_value_t field;
+
+        err = getFieldValue(col, record, &field);
+        if (err < 0) {
+            return RKV_INVALID_ARGUEMENTS;
+        }
+        if (err > 0) {
+            setFrameColumnNA(col, iRow);
+            err = 0;
+            continue;
+        }
+        switch (col->type) {
+        case AVRO_INT32:
+            err = avro_value_get_int(&field, &((int *)col->data)[iRow]);
+            break;
+        case AVRO_INT64:
+            err = avro_value_get_long(&field, &((int64_t *)col->data)[iRow]);
+            break;
+        case AVRO_FLOAT: {
+            float fValue = 0;
+            err = avro_value_get_float(&field, &fValue);
+            ((double *)col->data)[iRow] = fValue;
+            break;
+        }
+        case AVRO_DOUBLE:
+            err = avro_value_get_double(&field, &((double *)col->data)[iRow]);
+            break;
+        case AVRO_STRING: {
+            const char *strValue = NULL;
+            size_t size = 0;
+            err = avro_value_get_string(&field, &strValue, &size);
+            if (err == 0) {
+                /* The size counts the terminating NUL */
+                SET_STRING_ELT(col->vector, iRow,
+                               mkCharLenCE(strValue, size > 0 ? size - 1 : 0,
+                                           CE_UTF8));
+            }
+            break;
+        }
+        case AVRO_BOOLEAN:
+            err = avro_value_get_boolean(&field, &((int *)col->data)[iRow]);
+            break;
+        case AVRO_ENUM: {
+            int symbol = 0;
+            err = avro_value_get_enum(&field, &symbol);
+            /* Factor codes start at 1 */
+            ((int *)col->data)[iRow] = symbol + 1;
+            break;
+        }
+        case AVRO_BYTES:
+        case AVRO_FIXED: {
+            const void *buf = NULL;
+            size_t size = 0;
+            SEXP raw;
+
+            err = (col->type == AVRO_BYTES) ?
+                  avro_value_get_bytes(&field, &buf, &size) :
+                  avro_value_get_fixed(&field, &buf, &size);
+            if (err == 0) {
+                raw = allocVector(RAWSXP, size);
+                SET_VECTOR_ELT(col->vector, iRow, raw);
+                if (size > 0) {
+                    memcpy(RAW(raw), buf, size);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        if (err != 0) {
+            return RKV_INVALID_AVRO_SET_OP;
+        }
+    }
+    return RKV_SUCCESS;
+}
+
+/*
+ * Follow the path of the column down the nested records, 1 when a
+ * nullable union on the way is null and -1 if the record doesn't match.
+ */
+static int getFieldValue(const rkv_column_t *col, const avro_value_t *record,
+                         avro_value_t *ret_value) {
+    avro_value_t value = *record, branch;
+    int i;
+
+    for (i = 0; i < col->depth; i++) {
+        if (avro_value_get_by_index(&value, col->path[i], ret_value,
+                                    NULL) != 0) {
+            return -1;
+        }
+        if (avro_value_get_type(ret_value) == AVRO_UNION) {
+            if (avro_value_get_current_branch(ret_value, &branch) != 0) {
+                return -1;
+            }
+            *ret_value = branch;
+        }
+        if (avro_value_get_type(ret_value) == AVRO_NULL) {
+            return 1;
+        }
+        value = *ret_value;
+    }
+    return 0;
+}
+
+/*
+ * Append a value of the store. Records are decoded from their binary
+ * encoding when their writer schema lines up with the columns, otherwise
+ * through a generic avro value resolved against the reader schema. A
+ * record the filter rejects is not counted and RKV_FILTERED_OUT returned.
+ */
+rkv_error_t appendFrameValue(rkv_frame_t *frame, const kv_key_t *key,
+                             const kv_value_t *value) {
+    rkv_decode_plan_t *plan = NULL;
+    avro_value_t record;
+    rkv_error_t ret;
+
+    if (!frame || !value) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    if (frame->nRows >= frame->capacity) {
+        ret = growFrame(frame);
+        RETURN_IF_ERR(ret);
+    }
+
+    plan = getDecodePlan(frame, value);
+    if (plan != NULL && !rkv_decode_plan_has_writer(plan)) {
+        return RKV_VALUE_NOT_AVRO;
+    }
+    if (plan != NULL && rkv_decode_plan_is_direct(plan)) {
+        ret = rkv_decode_record(plan, kv_get_value(value),
+                                kv_get_value_size(value), frame->nRows);
+    } else {
+        ret = r_kv_read_avrovalue(value, &record, frame->schema);
+        RETURN_IF_ERR(ret);
+        ret = fillFrameRow(frame, &record);
+        avro_value_decref(&record);
+    }
+    RETURN_IF_ERR(ret);
+
+    if (frame->filter != NULL &&
+        !rkv_filter_match(frame->filter, frame->nRows, key)) {
+        return RKV_FILTERED_OUT;
+    }
+    frame->nRows++;
+    return RKV_SUCCESS;
+}
+
+rkv_error_t appendFrameNARow(rkv_frame_t *frame) {
+    R_xlen_t iRow;
+    int iCol;
+    rkv_error_t ret;
+
+    if (!frame) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    if (frame->nRows >= frame->capacity) {
+        ret = growFrame(frame);
+        RETURN_IF_ERR(ret);
+    }
+
+    iRow = frame->nRows;
+    for (iCol = 0; iCol < frame->nColumns; iCol++) {
+        setFrameColumnNA(&frame->columns[iCol], iRow);
+    }
+    frame->nRows++;
+    return RKV_SUCCESS;
+}
+
+/* A NULL element is the NA of the lists of raw vectors */
+void setFrameColumnNA(rkv_column_t *col, R_xlen_t row) {
+    switch (col->rtype) {
+    case INTSXP:
+        ((int *)col->data)[row] = NA_INTEGER;
+        break;
+    case REALSXP:
+        if (col->type == AVRO_INT64) {
+            ((int64_t *)col->data)[row] = RKV_NA_INTEGER64;
+        } else {
+            ((double *)col->data)[row] = NA_REAL;
+        }
+        break;
+    case STRSXP:
+        SET_STRING_ELT(col->vector, row, NA_STRING);
+        break;
+    case LGLSXP:
+        ((int *)col->data)[row] = NA_LOGICAL;
+        break;
+    case VECSXP:
+        SET_VECTOR_ELT(col->vector, row, R_NilValue);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Enum columns become factors with the symbols of the enum as levels. The
+ * int64_t copied into a long column are tagged integer64, or converted
+ * to doubles in place unless options(rkvstore.integer64=TRUE) is set.
+ */
+void finishFrameColumn(const rkv_column_t *col, SEXP vector) {
+    SEXP levels;
+    R_xlen_t iRow, nRows;
+    int i, n;
+
+    if (col->type == AVRO_INT64) {
+        if (useInteger64()) {
+            classgets(vector, cls_integer64);
+            return;
+        }
+        nRows = XLENGTH(vector);
+        for (iRow = 0; iRow < nRows; iRow++) {
+            int64_t value;
+
+            memcpy(&value, &REAL(vector)[iRow], sizeof(int64_t));
+            REAL(vector)[iRow] = (value == RKV_NA_INTEGER64) ?
+                                 NA_REAL : (double)value;
+        }
+        return;
+    }
+    if (col->type != AVRO_ENUM) {
+        return;
+    }
+    PROTECT(vector);
+    n = avro_schema_enum_number_of_symbols(col->schema);
+    PROTECT(levels = allocVector(STRSXP, n));
+    for (i = 0; i < n; i++) {
+        SET_STRING_ELT(levels, i,
+                       mkCharCE(avro_schema_enum_get(col->schema, i),
+                                CE_UTF8));
+    }
+    setAttrib(vector, R_LevelsSymbol, levels);
+    classgets(vector, PROTECT(mkString("factor")));
+    UNPROTECT(3);
+}
+
+/* The columns are copied once into vectors of the exact size */
+SEXP frameToDataFrame(rkv_frame_t *frame) {
+    SEXP columns, names, df;
+    int iCol;
+
+    PROTECT(columns = allocVector(VECSXP, frame->nVisible));
+    PROTECT(names = allocVector(STRSXP, frame->nVisible));
+    for (iCol = 0; iCol < frame->nVisible; iCol++) {
+        rkv_column_t *col = &frame->columns[iCol];
+        SEXP vector;
+
+        if (col->rtype == STRSXP || col->rtype == VECSXP) {
+            vector = col->vector;
+            if (frame->nRows < frame->capacity) {
+                vector = xlengthgets(vector, frame->nRows);
+            }
+        } else {
+            vector = allocVector(col->rtype, frame->nRows);
+            if (frame->nRows > 0) {
+                memcpy(getVectorData(vector), col->data,
+                       frame->nRows * getElementSize(col->rtype));
+            }
+        }
+        SET_VECTOR_ELT(columns, iCol, vector);
+        finishFrameColumn(col, vector);
+        SET_STRING_ELT(names, iCol, mkChar(col->name));
+    }
+    df = makeDataFrame(columns, names, frame->nRows);
+    UNPROTECT(2);
+    return df;
+}
+
+void releaseFrame(rkv_frame_t *frame) {
+    int i;
+
+    if (frame == NULL) {
+        return;
+    }
+    if (frame->columns != NULL) {
+        for (i = 0; i < frame->nColumns; i++) {
+            free(frame->columns[i].name);
+            free(frame->columns[i].path);
+            free(frame->columns[i].data);
+        }
+        free(frame->columns);
+    }
+    if (frame->vectors != NULL) {
+        R_ReleaseObject(frame->vectors);
+    }
+    for (i = 0; i < frame->nPlans; i++) {
+        rkv_decode_plan_release(frame->plans[i]);
+    }
+    free(frame->plans);
+    if (frame->schema != NULL) {
+        avro_schema_decref(frame->schema);
+    }
+    free(frame);
+}
+
+SEXP makeDataFrame(SEXP columns, SEXP names, R_xlen_t nRows) {
+    SEXP rowNames;
+
+    PROTECT(columns);
+    setAttrib(columns, R_NamesSymbol, names);
+    /* Compact form of the automatic row names 1..nRows */
+    PROTECT(rowNames = allocVector(INTSXP, 2));
+    INTEGER(rowNames)[0] = NA_INTEGER;
+    INTEGER(rowNames)[1] = -(int)nRows;
+    setAttrib(columns, R_RowNamesSymbol, rowNames);
+    classgets(columns, PROTECT(mkString("data.frame")));
+    UNPROTECT(3);
+    return columns;
+}
+
+/* Insert the column at position pos, the existing columns are shifted. */
+SEXP addDataFrameColumn(SEXP df, int pos, const char *name, SEXP column) {
+    SEXP ret, names, oldNames;
+    int i, j, nCols = LENGTH(df);
+
+    PROTECT(df);
+    PROTECT(column);
+    PROTECT(ret = allocVector(VECSXP, nCols + 1));
+    PROTECT(names = allocVector(STRSXP, nCols + 1));
+    oldNames = getAttrib(df, R_NamesSymbol);
+    for (i = 0, j = 0; i <= nCols; i++) {
+        if (i == pos) {
+            SET_VECTOR_ELT(ret, i, column);
+            SET_STRING_ELT(names, i, mkChar(name));
+            continue;
+        }
+        SET_VECTOR_ELT(ret, i, VECTOR_ELT(df, j));
+        SET_STRING_ELT(names, i, STRING_ELT(oldNames, j));
+        j++;
+    }
+    ret = makeDataFrame(ret, names, XLENGTH(column));
+    UNPROTECT(4);
+    return ret;
+}
+
+/*
+ * Resolve the data frame columns to the fields of the avro record once,
+ * fields without a matching column keep their default value. On
+ * RKV_INVALID_COLUMN_TYPE and RKV_VALUE_OUT_OF_RANGE, ret_field is the
+ * index of the field whose column is rejected.
+ */
+rkv_error_t createEncodeColumns(const avro_schema_t schema, SEXP df,
+                                rkv_encode_column_t **ret_columns,
+                                int *ret_size, int *ret_field) {
+    rkv_encode_column_t *columns = NULL;
+    rkv_avro_field *fields = NULL;
+    SEXP names;
+    int i, nFields = 0, nColumns = 0;
+    rkv_error_t ret;
+
+    if (!schema || !ret_columns || !ret_size || !ret_field) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    *ret_field = -1;
+
+    ret = getAvroSchemaFields(schema, &fields, &nFields);
+    RETURN_IF_ERR(ret);
+
+    ret = rkv_malloc(sizeof(rkv_encode_column_t) * (nFields + 1),
+                     (void**)&columns);
+    CLEANUP_IF_RERR(ret);
+
+    names = getAttrib(df, R_NamesSymbol);
+    for (i = 0; i < nFields; i++) {
+        SEXP column = getDataFrameColumn(df, names, fields[i].name);
+        if (column == R_NilValue) {
+            continue;
+        }
+        if (!isEncodableColumn(fields[i].type, column)) {
+            *ret_field = i;
+            ret = RKV_INVALID_COLUMN_TYPE;
+            goto Cleanup;
+        }
+        /* Reject the whole frame before any row is put */
+        if (!isColumnInFieldRange(fields[i].type, column)) {
+            *ret_field = i;
+            ret = RKV_VALUE_OUT_OF_RANGE;
+            goto Cleanup;
+        }
+        columns[nColumns].index = i;
+        columns[nColumns].type = fields[i].type;
+        columns[nColumns].column = column;
+        columns[nColumns].isInteger64 = isInteger64(column);
+        nColumns++;
+    }
+
+    *ret_columns = columns;
+    *ret_size = nColumns;
+    columns = NULL;
+
+Cleanup:
+    if (columns != NULL) {
+        free(columns);
+    }
+    release_avro_fields(fields, nFields);
+    return ret;
+}
+
+rkv_error_t encodeDataFrameRow(avro_value_t *record,
+                               const rkv_encode_column_t *columns,
+                               int nColumns, R_xlen_t row) {
+    avro_value_t field;
+    int i, err = 0;
+
+    if (!record || (!columns && nColumns)) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    avro_value_reset(record);
+    for (i = 0; i < nColumns && !err; i++) {
+        const rkv_encode_column_t *col = &columns[i];
+        SEXP column = col->column;
+
+        if (avro_value_get_by_index(record, col->index, &field, NULL) != 0) {
+            return RKV_ERROR;
+        }
+        switch (col->type) {
+        case AVRO_INT32:
+        case AVRO_INT64:
+        case AVRO_DOUBLE: {
+            double dValue;
+            if (col->isInteger64) {
+                int64_t i64Value;
+
+                /* Longs are set from the int64_t as is, without rounding */
+                memcpy(&i64Value, &REAL(column)[row], sizeof(int64_t));
+                if (i64Value == RKV_NA_INTEGER64) {
+                    return RKV_INVALID_ARGUEMENTS;
+                }
+                if (col->type == AVRO_INT64) {
+                    err = avro_value_set_long(&field, i64Value);
+                    break;
+                }
+                dValue = (double)i64Value;
+            } else if (TYPEOF(column) == INTSXP) {
+                if (INTEGER(column)[row] == NA_INTEGER) {
+                    return RKV_INVALID_ARGUEMENTS;
+                }
+                dValue = INTEGER(column)[row];
+            } else {
+                dValue = REAL(column)[row];
+                if (ISNAN(dValue)) {
+                    return RKV_INVALID_ARGUEMENTS;
+                }
+            }
+            if (!isInFieldRange(col->type, dValue)) {
+                return RKV_VALUE_OUT_OF_RANGE;
+            }
+            if (col->type == AVRO_INT32) {
+                err = avro_value_set_int(&field, (int32_t)dValue);
+            } else if (col->type == AVRO_INT64) {
+                err = avro_value_set_long(&field, (int64_t)dValue);
+            } else {
+                err = avro_value_set_double(&field, dValue);
+            }
+            break;
+        }
+        case AVRO_STRING: {
+            SEXP str = STRING_ELT(column, row);
+            if (str == NA_STRING) {
+                return RKV_INVALID_ARGUEMENTS;
+            }
+            err = avro_value_set_string_len(&field, CHAR(str),
+                                            LENGTH(str) + 1);
+            break;
+        }
+        case AVRO_BOOLEAN:
+            if (LOGICAL(column)[row] == NA_LOGICAL) {
+                return RKV_INVALID_ARGUEMENTS;
+            }
+            err = avro_value_set_boolean(&field, LOGICAL(column)[row]);
+            break;
+        default:
+            break;
+        }
+    }
+    return (err != 0) ? RKV_INVALID_AVRO_SET_OP : RKV_SUCCESS;
+}
+
+/* Raises the R error of a column rejected by createEncodeColumns */
+void errorEncodeColumn(const avro_schema_t schema, SEXP df, int field,
+                       rkv_error_t ret) {
+    avro_schema_t fieldSchema =
+        avro_schema_record_field_get_by_index(schema, field);
+    const char *name = avro_schema_record_field_name(schema, field);
+    SEXP column = getDataFrameColumn(df, getAttrib(df, R_NamesSymbol), name);
+    const char *type = type2char(TYPEOF(column));
+
+    if (isInteger64(column)) {
+        type = "integer64";
+    } else if (isFactor(column)) {
+        type = "factor";
+    }
+    if (ret == RKV_VALUE_OUT_OF_RANGE) {
+        error("Column \"%s\" has values out of the range of the field "
+              "of type %s.", name, avro_schema_type_name(fieldSchema));
+    }
+    error("Column \"%s\" of type %s can't be stored to the field of type "
+          "%s.", name, type, avro_schema_type_name(fieldSchema));
+}
+
+/* Whether the number is converted to the int or long field without overflow */
+static int isInFieldRange(avro_type_t type, double value) {
+    if (type == AVRO_INT32) {
+        return value > (double)INT32_MIN - 1 && value < (double)INT32_MAX + 1;
+    } else if (type == AVRO_INT64) {
+        return isInInt64Range(value);
+    }
+    return 1;
+}
+
+static int isColumnInFieldRange(avro_type_t type, SEXP column) {
+    R_xlen_t i, n = XLENGTH(column);
+
+    if ((type != AVRO_INT32 && type != AVRO_INT64) ||
+        TYPEOF(column) != REALSXP) {
+        return 1;
+    }
+    if (isInteger64(column)) {
+        const int64_t *values = (const int64_t *)REAL(column);
+
+        for (i = 0; type == AVRO_INT32 && i < n; i++) {
+            if (values[i] != RKV_NA_INTEGER64 &&
+                (values[i] < INT32_MIN || values[i] > INT32_MAX)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        /* NA rows are reported per row, they are not out of range */
+        if (!ISNAN(REAL(column)[i]) &&
+            !isInFieldRange(type, REAL(column)[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static SEXP getDataFrameColumn(SEXP df, SEXP names, const char *name) {
+    int i, len;
+
+    if (names == R_NilValue) {
+        return R_NilValue;
+    }
+    len = LENGTH(names);
+    for (i = 0; i < len; i++) {
+        if (strcmp(CHAR(STRING_ELT(names, i)), name) == 0) {
+            return VECTOR_ELT(df, i);
+        }
+    }
+    return R_NilValue;
+}
+
+static int isEncodableColumn(avro_type_t type, SEXP column) {
+    switch (type) {
+    case AVRO_INT32:
+    case AVRO_INT64:
+    case AVRO_DOUBLE:
+        return (TYPEOF(column) == INTSXP && !isFactor(column)) ||
+               TYPEOF(column) == REALSXP;
+    case AVRO_STRING:
+        return TYPEOF(column) == STRSXP;
+    case AVRO_BOOLEAN:
+        return TYPEOF(column) == LGLSXP;
+    default:
+        return 0;
+    }
+}
+
+/* The columns followed by the fields of the filter they do not have */
+static SEXP addFilterFields(SEXP columns, const rkv_filter_t *filter) {
+    SEXP ret;
+    int i, j, n = LENGTH(columns), nFields = rkv_filter_nfields(filter);
+
+    PROTECT(ret = allocVector(STRSXP, n + nFields));
+    for (i = 0; i < n; i++) {
+        SET_STRING_ELT(ret, i, STRING_ELT(columns, i));
+    }
+    for (i = 0; i < nFields; i++) {
+        const char *field = rkv_filter_field(filter, i);
+
+        for (j = 0; j < LENGTH(columns); j++) {
+            if (STRING_ELT(columns, j) != NA_STRING &&
+                strcmp(CHAR(STRING_ELT(columns, j)), field) == 0) {
+                break;
+            }
+        }
+        if (j == LENGTH(columns)) {
+            SET_STRING_ELT(ret, n++, mkChar(field));
+        }
+    }
+    ret = lengthgets(ret, n);
+    UNPROTECT(1);
+    return ret;
+}
+
+static void *getVectorData(SEXP vector) {
+    switch (TYPEOF(vector)) {
+    case INTSXP:
+        return INTEGER(vector);
+    case LGLSXP:
+        return LOGICAL(vector);
+    case REALSXP:
+        return REAL(vector);
+    default:
+        return NULL;
+    }
+}
+
+static size_t getElementSize(SEXPTYPE rtype) {
+    return (rtype == REALSXP) ? sizeof(double) : sizeof(int);
+}
+
+/*
+ * Double the row capacity of the columns, so that filling n rows copies
+ * O(n) elements in total. The native buffers of all the columns are
+ * allocated before any column is changed, on failure the frame is left
+ * as it was.
+ */
+static rkv_error_t growFrame(rkv_frame_t *frame) {
+    R_xlen_t capacity;
+    void **buffers = NULL;
+    int iCol;
+    rkv_error_t ret;
+
+    capacity = (frame->capacity > 0) ?
+               frame->capacity * 2 : RKV_FRAME_MIN_CAPACITY;
+    ret = rkv_malloc(sizeof(void *) * (frame->nColumns + 1),
+                     (void**)&buffers);
+    RETURN_IF_ERR(ret);
+    for (iCol = 0; iCol < frame->nColumns; iCol++) {
+        rkv_column_t *col = &frame->columns[iCol];
+
+        if (col->rtype == STRSXP || col->rtype == VECSXP) {
+            continue;
+        }
+        buffers[iCol] = malloc(capacity * getElementSize(col->rtype));
+        if (buffers[iCol] == NULL) {
+            ret = RKV_NO_MEMORY;
+            goto Cleanup;
+        }
+    }
+
+    for (iCol = 0; iCol < frame->nColumns; iCol++) {
+        rkv_column_t *col = &frame->columns[iCol];
+
+        if (col->rtype == STRSXP || col->rtype == VECSXP) {
+            col->vector = xlengthgets(col->vector, capacity);
+            SET_VECTOR_ELT(frame->vectors, iCol, col->vector);
+        } else {
+            if (col->data != NULL) {
+                memcpy(buffers[iCol], col->data,
+                       frame->nRows * getElementSize(col->rtype));
+                free(col->data);
+            }
+            col->data = buffers[iCol];
+            buffers[iCol] = NULL;
+        }
+    }
+    frame->capacity = capacity;
+
+Cleanup:
+    for (iCol = 0; iCol < frame->nColumns; iCol++) {
+        free(buffers[iCol]);
+    }
+    free(buffers);
+    return ret;
+}
+
+/*
+ * Plans are few, one per version of the schema found in the store. They
+ * are looked up by the schema id that prefixes the value, the writer
+ * schema is only resolved for the first value of a version. An id whose
+ * writer schema can't be resolved gets a plan without writer, so it is
+ * not resolved again for every value.
+ */
+static rkv_decode_plan_t *getDecodePlan(rkv_frame_t *frame,
+                                        const kv_value_t *value) {
+    rkv_decode_plan_t *plan = NULL, **plans;
+    const unsigned char *data = kv_get_value(value);
+    avro_schema_t writer = NULL;
+    int i, idSize;
+    rkv_error_t ret;
+
+    idSize = rkv_decode_schema_id_size(data, kv_get_value_size(value));
+    if (idSize < 0) {
+        return NULL;
+    }
+    for (i = 0; i < frame->nPlans; i++) {
+        if (rkv_decode_plan_has_id(frame->plans[i], data, idSize)) {
+            return frame->plans[i];
+        }
+    }
+
+    plans = realloc(frame->plans,
+                    (frame->nPlans + 1) * sizeof(rkv_decode_plan_t *));
+    if (plans == NULL) {
+        return NULL;
+    }
+    frame->plans = plans;
+    if (kv_avro_get_schema(value, &writer) != KV_SUCCESS) {
+        writer = NULL;
+    }
+    /* The plan holds its own reference to the writer schema */
+    ret = rkv_decode_plan_create(writer, data, idSize, frame->columns,
+                                 frame->nColumns, &plan);
+    if (writer != NULL) {
+        avro_schema_decref(writer);
+    }
+    if (ret != RKV_SUCCESS) {
+        return NULL;
+    }
+    frame->plans[frame->nPlans++] = plan;
+    return plan;
+}
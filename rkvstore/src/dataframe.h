@@ -0,0 +1,152 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#ifndef __DATAFRAME_H__
+#define __DATAFRAME_H__
+
+#include <Rinternals.h>
+#include <kvstore.h>
+
+#include "rkverr.h"
+
+/* Initial capacity of a frame created without a size hint */
+#define RKV_FRAME_MIN_CAPACITY  256
+
+/* The NA of bit64, long columns hold int64_t in their native buffer */
+#define RKV_NA_INTEGER64        INT64_MIN
+
+/* Records nested deeper are not flattened into columns */
+#define RKV_FRAME_MAX_DEPTH     16
+
+typedef struct {
+    char *name;
+    avro_type_t type;
+    int index;
+    int *path;                  /* flattened fields only, NULL otherwise */
+    int depth;
+    avro_schema_t schema;       /* flattened fields only, not owned */
+}rkv_avro_field;
+
+/*
+ * A column of the data frame decoded from a field of an avro record, or
+ * from a field of a nested record with a dotted name. The path of field
+ * indexes is resolved once so that rows are decoded without name lookups.
+ * The type is the one of the value, a union of null and that type is
+ * NA when it is null. Numeric, logical and enum columns are filled in a
+ * native buffer, int64_t for longs, string columns in a STRSXP and bytes or fixed columns
+ * in a list of raw vectors, all grow geometrically with the frame.
+ */
+typedef struct rkv_column {
+    char *name;
+    avro_type_t type;
+    int *path;
+    int depth;
+    avro_schema_t schema;       /* of the value in the reader schema */
+    SEXPTYPE rtype;
+    SEXP vector;                /* STRSXP and VECSXP columns only */
+    void *data;                 /* native buffer of the other columns */
+}rkv_column_t;
+
+/*
+ * Column builders that decode avro records into a R data frame, the
+ * capacity passed at creation is only the initial one.
+ */
+typedef struct rkv_frame {
+    rkv_column_t *columns;
+    int nColumns;
+    SEXP vectors;
+    R_xlen_t nRows;
+    R_xlen_t capacity;
+    avro_schema_t schema;       /* reader schema */
+    struct rkv_decode_plan **plans; /* one per writer schema seen */
+    int nPlans;
+    struct rkv_filter *filter;  /* not owned, NULL keeps every row */
+    int nVisible;               /* the columns after are only filtered on */
+}rkv_frame_t;
+
+/* Maps a column of a R data frame to a field of an avro record. */
+typedef struct rkv_encode_column {
+    int index;
+    avro_type_t type;
+    SEXP column;
+    int isInteger64;
+}rkv_encode_column_t;
+
+rkv_error_t getAvroSchemaFields(const avro_schema_t schema,
+                                rkv_avro_field ** ret_avro_fields,
+                                int * ret_field_size);
+rkv_error_t getFlatSchemaFields(const avro_schema_t schema,
+                                rkv_avro_field **ret_avro_fields,
+                                int *ret_field_size);
+rkv_error_t filterAvroSchemaFields(rkv_avro_field **fields, int *nFields,
+                                   SEXP columns);
+void release_avro_fields(rkv_avro_field *fields, int nFields);
+avro_schema_t unwrapNullable(avro_schema_t schema, int *ret_null_branch);
+
+/* avro record -> data frame */
+rkv_error_t createFrame(const avro_schema_t schema, SEXP columns,
+                        struct rkv_filter *filter, R_xlen_t capacity,
+                        rkv_frame_t **ret_frame);
+rkv_error_t appendFrameRow(rkv_frame_t *frame, avro_value_t *record);
+rkv_error_t appendFrameValue(rkv_frame_t *frame, const kv_key_t *key,
+                             const kv_value_t *value);
+rkv_error_t appendFrameNARow(rkv_frame_t *frame);
+void setFrameColumnNA(rkv_column_t *col, R_xlen_t row);
+void finishFrameColumn(const rkv_column_t *col, SEXP vector);
+SEXP frameToDataFrame(rkv_frame_t *frame);
+void releaseFrame(rkv_frame_t *frame);
+SEXP makeDataFrame(SEXP columns, SEXP names, R_xlen_t nRows);
+SEXP addDataFrameColumn(SEXP df, int pos, const char *name, SEXP column);
+
+/* data frame -> avro record */
+rkv_error_t createEncodeColumns(const avro_schema_t schema, SEXP df,
+                                rkv_encode_column_t **ret_columns,
+                                int *ret_size, int *ret_field);
+void errorEncodeColumn(const avro_schema_t schema, SEXP df, int field,
+                       rkv_error_t ret) __attribute__((noreturn));
+rkv_error_t encodeDataFrameRow(avro_value_t *record,
+                               const rkv_encode_column_t *columns,
+                               int nColumns, R_xlen_t row);
+
+#endif
@@ -0,0 +1,794 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "utils.h"
+#include "rkvstore_internal.h"
+#include "filter.h"
+
+/*
+ * The expression is parsed once into a tree, rkv_filter_bind() resolves
+ * the field names to the columns of a frame and checks the types, then
+ * rkv_filter_match() is evaluated on each row decoded into the frame.
+ */
+typedef enum {
+    FILTER_AND,
+    FILTER_OR,
+    FILTER_NOT,
+    FILTER_COMPARE,             /* operand op literal */
+    FILTER_PREFIX,              /* startsWith(operand, literal) */
+    FILTER_TRUTH                /* a logical field alone */
+} rkv_filter_node_type_t;
+
+typedef enum {
+    FILTER_EQ,
+    FILTER_NE,
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_GT,
+    FILTER_GE
+} rkv_filter_op_t;
+
+typedef enum {
+    OPERAND_FIELD,
+    OPERAND_MAJOR,
+    OPERAND_MINOR
+} rkv_filter_operand_t;
+
+/* Results of the nodes, NA propagates through & | ! as it does in R */
+typedef enum {
+    FILTER_FALSE,
+    FILTER_TRUE,
+    FILTER_NA
+} rkv_filter_value_t;
+
+typedef enum {
+    LITERAL_NUMBER,
+    LITERAL_STRING,
+    LITERAL_LOGICAL
+} rkv_filter_literal_t;
+
+typedef struct rkv_filter_node {
+    rkv_filter_node_type_t type;
+    struct rkv_filter_node *left;
+    struct rkv_filter_node *right;
+    rkv_filter_op_t op;
+    rkv_filter_operand_t operand;
+    int field;                  /* index in the fields of the filter */
+    int component;              /* 0-based key path component */
+    rkv_filter_literal_t literal;
+    double number;              /* also the value of a logical literal */
+    int isIntegral;             /* the number is exactly 'integer' */
+    int64_t integer;
+    char *string;
+    size_t stringLen;
+} rkv_filter_node_t;
+
+struct rkv_filter {
+    rkv_filter_node_t *root;
+    char **fields;              /* distinct names of the fields used */
+    rkv_column_t **columns;     /* bound column of each field */
+    int nFields;
+};
+
+typedef struct rkv_filter_parser {
+    const char *expr;
+    const char *p;
+    rkv_filter_t *filter;
+    int failed;
+} rkv_filter_parser_t;
+
+static rkv_filter_node_t *parseOr(rkv_filter_parser_t *parser);
+static rkv_filter_node_t *parseAnd(rkv_filter_parser_t *parser);
+static rkv_filter_node_t *parseUnary(rkv_filter_parser_t *parser);
+static rkv_filter_node_t *parseTerm(rkv_filter_parser_t *parser);
+static int parseOperand(rkv_filter_parser_t *parser, rkv_filter_node_t *node,
+                        const char *ident, size_t len);
+static int parseLiteral(rkv_filter_parser_t *parser, rkv_filter_node_t *node);
+static int parseIdentifier(rkv_filter_parser_t *parser,
+                           const char **ret_start, size_t *ret_len);
+static int accept(rkv_filter_parser_t *parser, const char *token);
+static int addField(rkv_filter_t *filter, const char *name, size_t len);
+static rkv_filter_node_t *newNode(rkv_filter_parser_t *parser,
+                                  rkv_filter_node_type_t type,
+                                  rkv_filter_node_t *left,
+                                  rkv_filter_node_t *right);
+static void releaseNode(rkv_filter_node_t *node);
+static rkv_error_t bindNode(rkv_filter_t *filter, rkv_filter_node_t *node);
+static rkv_filter_value_t evalNode(const rkv_filter_t *filter,
+                                   const rkv_filter_node_t *node,
+                                   R_xlen_t row, const kv_key_t *key,
+                                   const char **uri);
+static int getKeyComponent(const char *uri, int isMinor, int index,
+                           const char **ret_start, size_t *ret_len);
+static int compareStrings(const char *a, size_t aLen,
+                          const char *b, size_t bLen);
+static rkv_filter_value_t testOrder(rkv_filter_op_t op, int cmp);
+
+rkv_error_t rkv_filter_create(const char *expr,
+                              rkv_filter_t **ret_filter,
+                              int *ret_error_offset) {
+    rkv_filter_parser_t parser;
+    rkv_filter_t *filter = NULL;
+    rkv_error_t ret;
+
+    if (!expr || !ret_filter) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    ret = rkv_malloc(sizeof(rkv_filter_t), (void**)&filter);
+    RETURN_IF_ERR(ret);
+
+    memset(&parser, 0, sizeof(parser));
+    parser.expr = expr;
+    parser.p = expr;
+    parser.filter = filter;
+    filter->root = parseOr(&parser);
+    if (!parser.failed && !accept(&parser, "")) {
+        parser.failed = 1;
+    }
+    if (parser.failed) {
+        if (ret_error_offset) {
+            *ret_error_offset = (int)(parser.p - expr);
+        }
+        rkv_filter_release(filter);
+        return RKV_INVALID_FILTER;
+    }
+
+    *ret_filter = filter;
+    return RKV_SUCCESS;
+}
+
+int rkv_filter_nfields(const rkv_filter_t *filter) {
+    return filter->nFields;
+}
+
+const char *rkv_filter_field(const rkv_filter_t *filter, int i) {
+    return filter->fields[i];
+}
+
+/* The columns must outlive the filter, their data is read at each match */
+rkv_error_t rkv_filter_bind(rkv_filter_t *filter,
+                            rkv_column_t *columns,
+                            int nColumns) {
+    int i, j;
+
+    if (!filter) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    for (i = 0; i < filter->nFields; i++) {
+        filter->columns[i] = NULL;
+        for (j = 0; j < nColumns; j++) {
+            if (strcmp(columns[j].name, filter->fields[i]) == 0) {
+                filter->columns[i] = &columns[j];
+                break;
+            }
+        }
+        if (filter->columns[i] == NULL) {
+            return RKV_INVALID_COLUMN;
+        }
+    }
+    return bindNode(filter, filter->root);
+}
+
+int rkv_filter_match(const rkv_filter_t *filter,
+                     R_xlen_t row,
+                     const kv_key_t *key) {
+    const char *uri = NULL;
+
+    /* A row is only kept if the filter is TRUE, NA rejects it */
+    return evalNode(filter, filter->root, row, key, &uri) == FILTER_TRUE;
+}
+
+void rkv_filter_release(rkv_filter_t *filter) {
+    int i;
+
+    if (filter == NULL) {
+        return;
+    }
+    releaseNode(filter->root);
+    for (i = 0; i < filter->nFields; i++) {
+        free(filter->fields[i]);
+    }
+    free(filter->fields);
+    free(filter->columns);
+    free(filter);
+}
+
+static rkv_filter_node_t *parseOr(rkv_filter_parser_t *parser) {
+    rkv_filter_node_t *node = parseAnd(parser);
+
+    while (node != NULL && (accept(parser, "||") || accept(parser, "|"))) {
+        node = newNode(parser, FILTER_OR, node, parseAnd(parser));
+    }
+    return node;
+}
+
+static rkv_filter_node_t *parseAnd(rkv_filter_parser_t *parser) {
+    rkv_filter_node_t *node = parseUnary(parser);
+
+    while (node != NULL && (accept(parser, "&&") || accept(parser, "&"))) {
+        node = newNode(parser, FILTER_AND, node, parseUnary(parser));
+    }
+    return node;
+}
+
+static rkv_filter_node_t *parseUnary(rkv_filter_parser_t *parser) {
+    rkv_filter_node_t *node = NULL;
+
+    if (accept(parser, "!")) {
+        return newNode(parser, FILTER_NOT, parseUnary(parser), NULL);
+    }
+    if (accept(parser, "(")) {
+        node = parseOr(parser);
+        if (node != NULL && !accept(parser, ")")) {
+            releaseNode(node);
+            parser->failed = 1;
+            return NULL;
+        }
+        return node;
+    }
+    return parseTerm(parser);
+}
+
+static rkv_filter_node_t *parseTerm(rkv_filter_parser_t *parser) {
+    rkv_filter_node_t *node = NULL;
+    const char *ident;
+    size_t len;
+
+    if (!parseIdentifier(parser, &ident, &len)) {
+        parser->failed = 1;
+        return NULL;
+    }
+    node = newNode(parser, FILTER_COMPARE, NULL, NULL);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (len == 10 && strncmp(ident, "startsWith", len) == 0) {
+        node->type = FILTER_PREFIX;
+        if (!accept(parser, "(") ||
+            !parseIdentifier(parser, &ident, &len) ||
+            !parseOperand(parser, node, ident, len) ||
+            !accept(parser, ",") ||
+            !parseLiteral(parser, node) ||
+            node->literal != LITERAL_STRING ||
+            !accept(parser, ")")) {
+            goto Error;
+        }
+        return node;
+    }
+
+    if (!parseOperand(parser, node, ident, len)) {
+        goto Error;
+    }
+    if (accept(parser, "==")) {
+        node->op = FILTER_EQ;
+    } else if (accept(parser, "!=")) {
+        node->op = FILTER_NE;
+    } else if (accept(parser, "<=")) {
+        node->op = FILTER_LE;
+    } else if (accept(parser, ">=")) {
+        node->op = FILTER_GE;
+    } else if (accept(parser, "<")) {
+        node->op = FILTER_LT;
+    } else if (accept(parser, ">")) {
+        node->op = FILTER_GT;
+    } else if (node->operand == OPERAND_FIELD) {
+        node->type = FILTER_TRUTH;
+        return node;
+    } else {
+        goto Error;
+    }
+    if (!parseLiteral(parser, node)) {
+        goto Error;
+    }
+    /* The components of a key are strings */
+    if (node->operand != OPERAND_FIELD && node->literal != LITERAL_STRING) {
+        goto Error;
+    }
+    return node;
+
+Error:
+    releaseNode(node);
+    parser->failed = 1;
+    return NULL;
+}
+
+/* The identifier was just read, major[i] and minor[i] refer to the key */
+static int parseOperand(rkv_filter_parser_t *parser, rkv_filter_node_t *node,
+                        const char *ident, size_t len) {
+    long index;
+    char *end;
+
+    if ((len == 5 && strncmp(ident, "major", len) == 0) ||
+        (len == 5 && strncmp(ident, "minor", len) == 0)) {
+        node->operand = (ident[1] == 'a') ? OPERAND_MAJOR : OPERAND_MINOR;
+        if (!accept(parser, "[")) {
+            return 0;
+        }
+        index = strtol(parser->p, &end, 10);
+        if (end == parser->p || index < 1 || index > 1000000) {
+            return 0;
+        }
+        parser->p = end;
+        node->component = (int)index - 1;
+        return accept(parser, "]");
+    }
+
+    node->operand = OPERAND_FIELD;
+    node->field = addField(parser->filter, ident, len);
+    return node->field >= 0;
+}
+
+static int parseLiteral(rkv_filter_parser_t *parser, rkv_filter_node_t *node) {
+    const char *p;
+    char *end, *intEnd;
+    long long integer;
+    size_t len = 0;
+
+    accept(parser, "");
+    p = parser->p;
+    if (*p == '"' || *p == '\'') {
+        char quote = *p++;
+        const char *q;
+
+        for (q = p; *q != '\0' && *q != quote; q++) {
+            if (*q == '\\' && q[1] != '\0') {
+                q++;
+            }
+            len++;
+        }
+        if (*q != quote) {
+            return 0;
+        }
+        node->string = malloc(len + 1);
+        if (node->string == NULL) {
+            return 0;
+        }
+        for (len = 0; p < q; p++) {
+            if (*p == '\\') {
+                p++;
+            }
+            node->string[len++] = *p;
+        }
+        node->string[len] = '\0';
+        node->stringLen = len;
+        node->literal = LITERAL_STRING;
+        parser->p = q + 1;
+        return 1;
+    }
+
+    if (isalpha((unsigned char)*p)) {
+        const char *ident;
+
+        parseIdentifier(parser, &ident, &len);
+        node->literal = LITERAL_LOGICAL;
+        if ((len == 4 && strncmp(ident, "TRUE", len) == 0) ||
+            (len == 1 && *ident == 'T')) {
+            node->number = 1;
+            return 1;
+        }
+        if ((len == 5 && strncmp(ident, "FALSE", len) == 0) ||
+            (len == 1 && *ident == 'F')) {
+            node->number = 0;
+            return 1;
+        }
+        parser->p = p;
+        return 0;
+    }
+
+    node->number = strtod(p, &end);
+    if (end == p) {
+        return 0;
+    }
+    node->literal = LITERAL_NUMBER;
+
+    /*
+     * Integers are also kept as int64_t, long fields are compared to them
+     * exactly, a double only has 53 bits of precision.
+     */
+    errno = 0;
+    integer = strtoll(p, &intEnd, 10);
+    if (intEnd == end && errno == 0) {
+        node->isIntegral = 1;
+        node->integer = integer;
+    } else if (node->number == floor(node->number) &&
+               node->number >= -9223372036854775808.0 &&
+               node->number < 9223372036854775808.0) {
+        node->isIntegral = 1;
+        node->integer = (int64_t)node->number;
+    }
+    parser->p = end;
+    return 1;
+}
+
+static int parseIdentifier(rkv_filter_parser_t *parser,
+                           const char **ret_start, size_t *ret_len) {
+    const char *p;
+
+    accept(parser, "");
+    p = parser->p;
+    if (!isalpha((unsigned char)*p) && *p != '_' && *p != '.') {
+        return 0;
+    }
+    while (isalnum((unsigned char)*p) || *p == '_' || *p == '.') {
+        p++;
+    }
+    *ret_start = parser->p;
+    *ret_len = p - parser->p;
+    parser->p = p;
+    return 1;
+}
+
+/* Skip the blanks then consume the token if it is next, "" tests the end */
+static int accept(rkv_filter_parser_t *parser, const char *token) {
+    size_t len = strlen(token);
+
+    while (isspace((unsigned char)*parser->p)) {
+        parser->p++;
+    }
+    if (len == 0) {
+        return *parser->p == '\0';
+    }
+    if (strncmp(parser->p, token, len) != 0) {
+        return 0;
+    }
+    /* "!" must not take the start of "!=" and "<" the start of "<=" */
+    if (len == 1 && parser->p[1] == '=' && strchr("!<>", *token) != NULL) {
+        return 0;
+    }
+    parser->p += len;
+    return 1;
+}
+
+static int addField(rkv_filter_t *filter, const char *name, size_t len) {
+    char **fields;
+    rkv_column_t **columns;
+    int i;
+
+    for (i = 0; i < filter->nFields; i++) {
+        if (strlen(filter->fields[i]) == len &&
+            strncmp(filter->fields[i], name, len) == 0) {
+            return i;
+        }
+    }
+    fields = realloc(filter->fields, (filter->nFields + 1) * sizeof(char *));
+    if (fields == NULL) {
+        return -1;
+    }
+    filter->fields = fields;
+    columns = realloc(filter->columns,
+                      (filter->nFields + 1) * sizeof(rkv_column_t *));
+    if (columns == NULL) {
+        return -1;
+    }
+    filter->columns = columns;
+    if ((fields[filter->nFields] = malloc(len + 1)) == NULL) {
+        return -1;
+    }
+    memcpy(fields[filter->nFields], name, len);
+    fields[filter->nFields][len] = '\0';
+    columns[filter->nFields] = NULL;
+    return filter->nFields++;
+}
+
+/* A failed operand fails the node, the operands are released with it */
+static rkv_filter_node_t *newNode(rkv_filter_parser_t *parser,
+                                  rkv_filter_node_type_t type,
+                                  rkv_filter_node_t *left,
+                                  rkv_filter_node_t *right) {
+    rkv_filter_node_t *node = NULL;
+    int needRight = (type == FILTER_AND || type == FILTER_OR);
+
+    if ((type == FILTER_NOT || needRight) &&
+        (left == NULL || (needRight && right == NULL))) {
+        releaseNode(left);
+        releaseNode(right);
+        parser->failed = 1;
+        return NULL;
+    }
+    if (rkv_malloc(sizeof(rkv_filter_node_t), (void**)&node) != RKV_SUCCESS) {
+        releaseNode(left);
+        releaseNode(right);
+        parser->failed = 1;
+        return NULL;
+    }
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static void releaseNode(rkv_filter_node_t *node) {
+    if (node == NULL) {
+        return;
+    }
+    releaseNode(node->left);
+    releaseNode(node->right);
+    free(node->string);
+    free(node);
+}
+
+static rkv_error_t bindNode(rkv_filter_t *filter, rkv_filter_node_t *node) {
+    avro_type_t type;
+    rkv_error_t ret;
+
+    switch (node->type) {
+    case FILTER_AND:
+    case FILTER_OR:
+        ret = bindNode(filter, node->left);
+        RETURN_IF_ERR(ret);
+        return bindNode(filter, node->right);
+    case FILTER_NOT:
+        return bindNode(filter, node->left);
+    default:
+        break;
+    }
+    if (node->operand != OPERAND_FIELD) {
+        return RKV_SUCCESS;
+    }
+
+    type = filter->columns[node->field]->type;
+    switch (node->type) {
+    case FILTER_TRUTH:
+        return (type == AVRO_BOOLEAN) ? RKV_SUCCESS : RKV_INVALID_FILTER;
+    case FILTER_PREFIX:
+        return (type == AVRO_STRING) ? RKV_SUCCESS : RKV_INVALID_FILTER;
+    default:
+        break;
+    }
+    switch (type) {
+    case AVRO_INT32:
+    case AVRO_INT64:
+    case AVRO_FLOAT:
+    case AVRO_DOUBLE:
+        return (node->literal == LITERAL_NUMBER) ?
+               RKV_SUCCESS : RKV_INVALID_FILTER;
+    case AVRO_STRING:
+        return (node->literal == LITERAL_STRING) ?
+               RKV_SUCCESS : RKV_INVALID_FILTER;
+    case AVRO_BOOLEAN:
+        return (node->literal == LITERAL_LOGICAL &&
+                (node->op == FILTER_EQ || node->op == FILTER_NE)) ?
+               RKV_SUCCESS : RKV_INVALID_FILTER;
+    default:
+        return RKV_INVALID_FILTER;
+    }
+}
+
+static rkv_filter_value_t evalNode(const rkv_filter_t *filter,
+                                   const rkv_filter_node_t *node,
+                                   R_xlen_t row, const kv_key_t *key,
+                                   const char **uri) {
+    const rkv_column_t *col;
+    const char *str = NULL;
+    size_t len = 0;
+    double number = 0;
+    rkv_filter_value_t left, right;
+
+    switch (node->type) {
+    case FILTER_AND:
+        left = evalNode(filter, node->left, row, key, uri);
+        if (left == FILTER_FALSE) {
+            return FILTER_FALSE;
+        }
+        right = evalNode(filter, node->right, row, key, uri);
+        if (right == FILTER_FALSE) {
+            return FILTER_FALSE;
+        }
+        return (left == FILTER_TRUE && right == FILTER_TRUE) ?
+               FILTER_TRUE : FILTER_NA;
+    case FILTER_OR:
+        left = evalNode(filter, node->left, row, key, uri);
+        if (left == FILTER_TRUE) {
+            return FILTER_TRUE;
+        }
+        right = evalNode(filter, node->right, row, key, uri);
+        if (right == FILTER_TRUE) {
+            return FILTER_TRUE;
+        }
+        return (left == FILTER_FALSE && right == FILTER_FALSE) ?
+               FILTER_FALSE : FILTER_NA;
+    case FILTER_NOT:
+        left = evalNode(filter, node->left, row, key, uri);
+        if (left == FILTER_NA) {
+            return FILTER_NA;
+        }
+        return (left == FILTER_TRUE) ? FILTER_FALSE : FILTER_TRUE;
+    default:
+        break;
+    }
+
+    /* Read the operand, the comparison of a NA value is NA */
+    if (node->operand != OPERAND_FIELD) {
+        if (key == NULL) {
+            return FILTER_NA;
+        }
+        if (*uri == NULL && r_kv_get_key_uri(key, uri) != RKV_SUCCESS) {
+            return FILTER_NA;
+        }
+        if (!getKeyComponent(*uri, node->operand == OPERAND_MINOR,
+                             node->component, &str, &len)) {
+            return FILTER_NA;
+        }
+    } else {
+        col = filter->columns[node->field];
+        switch (col->type) {
+        case AVRO_INT32: {
+            int value = ((const int *)col->data)[row];
+            if (value == NA_INTEGER) {
+                return FILTER_NA;
+            }
+            number = value;
+            break;
+        }
+        case AVRO_INT64: {
+            int64_t value = ((const int64_t *)col->data)[row];
+            if (value == RKV_NA_INTEGER64) {
+                return FILTER_NA;
+            }
+            if (node->type == FILTER_COMPARE && node->isIntegral) {
+                return testOrder(node->op, (value > node->integer) -
+                                           (value < node->integer));
+            }
+            number = (double)value;
+            break;
+        }
+        case AVRO_FLOAT:
+        case AVRO_DOUBLE:
+            number = ((const double *)col->data)[row];
+            if (ISNAN(number)) {
+                return FILTER_NA;
+            }
+            break;
+        case AVRO_BOOLEAN: {
+            int value = ((const int *)col->data)[row];
+            if (value == NA_LOGICAL) {
+                return FILTER_NA;
+            }
+            number = value;
+            break;
+        }
+        case AVRO_STRING: {
+            SEXP value = STRING_ELT(col->vector, row);
+            if (value == NA_STRING) {
+                return FILTER_NA;
+            }
+            str = CHAR(value);
+            len = LENGTH(value);
+            break;
+        }
+        default:
+            return FILTER_NA;
+        }
+    }
+
+    switch (node->type) {
+    case FILTER_TRUTH:
+        return (number != 0) ? FILTER_TRUE : FILTER_FALSE;
+    case FILTER_PREFIX:
+        return (len >= node->stringLen &&
+                memcmp(str, node->string, node->stringLen) == 0) ?
+               FILTER_TRUE : FILTER_FALSE;
+    default:
+        break;
+    }
+    if (node->literal == LITERAL_STRING) {
+        return testOrder(node->op, compareStrings(str, len, node->string,
+                                                  node->stringLen));
+    }
+    return testOrder(node->op, (number > node->number) -
+                               (number < node->number));
+}
+
+/* Components of "/major1/major2/-/minor1", "-" starts the minor path */
+static int getKeyComponent(const char *uri, int isMinor, int index,
+                           const char **ret_start, size_t *ret_len) {
+    const char *p = uri, *end;
+    int inMinor = 0, i = 0;
+    size_t len;
+
+    if (*p == '/') {
+        p++;
+    }
+    while (*p != '\0') {
+        end = strchr(p, '/');
+        len = (end != NULL) ? (size_t)(end - p) : strlen(p);
+        if (len == 1 && *p == '-') {
+            inMinor = 1;
+            i = 0;
+        } else if (inMinor == isMinor) {
+            if (i == index) {
+                *ret_start = p;
+                *ret_len = len;
+                return 1;
+            }
+            i++;
+        }
+        if (end == NULL) {
+            break;
+        }
+        p = end + 1;
+    }
+    return 0;
+}
+
+static int compareStrings(const char *a, size_t aLen,
+                          const char *b, size_t bLen) {
+    int cmp = memcmp(a, b, (aLen < bLen) ? aLen : bLen);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (aLen > bLen) - (aLen < bLen);
+}
+
+static rkv_filter_value_t testOrder(rkv_filter_op_t op, int cmp) {
+    int result = 0;
+
+    switch (op) {
+    case FILTER_EQ:
+        result = (cmp == 0);
+        break;
+    case FILTER_NE:
+        result = (cmp != 0);
+        break;
+    case FILTER_LT:
+        result = (cmp < 0);
+        break;
+    case FILTER_LE:
+        result = (cmp <= 0);
+        break;
+    case FILTER_GT:
+        result = (cmp > 0);
+        break;
+    case FILTER_GE:
+        result = (cmp >= 0);
+        break;
+    }
+    return result ? FILTER_TRUE : FILTER_FALSE;
+}
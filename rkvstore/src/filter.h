@@ -0,0 +1,81 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+#include <kvstore.h>
+#include "rkverr.h"
+#include "dataframe.h"
+
+/*
+ * A predicate on the decoded fields of a record and on the components of
+ * its key, for instance:
+ *
+ *     age > 30 & expired == FALSE
+ *     startsWith(major[2], "group") | name == "Tom"
+ *
+ * Comparisons are ==, !=, <, <=, >, >= against a number, a string, TRUE
+ * or FALSE, startsWith(x, "prefix") tests a string prefix and a logical
+ * field may be used alone. Terms are combined with &, |, ! and
+ * parentheses. major[i] and minor[i] are the 1-based components of the
+ * key path as written in the key URI. A comparison with a NA value is
+ * FALSE.
+ */
+typedef struct rkv_filter rkv_filter_t;
+
+rkv_error_t rkv_filter_create(const char *expr,
+                              rkv_filter_t **ret_filter,
+                              int *ret_error_offset);
+int rkv_filter_nfields(const rkv_filter_t *filter);
+const char *rkv_filter_field(const rkv_filter_t *filter, int i);
+rkv_error_t rkv_filter_bind(rkv_filter_t *filter,
+                            rkv_column_t *columns,
+                            int nColumns);
+int rkv_filter_match(const rkv_filter_t *filter,
+                     R_xlen_t row,
+                     const kv_key_t *key);
+void rkv_filter_release(rkv_filter_t *filter);
+
+#endif
@@ -0,0 +1,323 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#include <pthread.h>
+#include <time.h>
+
+#include "utils.h"
+#include "rkvstore_internal.h"
+#include "prefetch.h"
+
+/*
+ * Read-ahead of an iterator: a producer thread keeps calling
+ * kv_iterator_next() and pushes copies of the records into a bounded
+ * single producer / single consumer ring, the R thread pops them. The
+ * ring indexes are only touched with atomic loads and stores, the lock
+ * and the conditions are used to sleep when the ring is empty or full.
+ * The producer is attached to the JVM for its whole life.
+ */
+typedef struct rkv_prefetch_slot {
+    kv_key_t *key;
+    kv_value_t *value;
+} rkv_prefetch_slot_t;
+
+struct rkv_prefetch {
+    kv_store_t *kvstore;
+    kv_iterator_t *iterator;
+    rkv_itr_stats_t *stats;     /* only written by the producer */
+    rkv_prefetch_slot_t *slots;
+    unsigned long mask;
+    unsigned long head;         /* next slot to pop, written by consumer */
+    unsigned long tail;         /* next slot to push, written by producer */
+    int done;                   /* producer result once it has stopped */
+    int stop;                   /* asks the producer to stop */
+    int joined;                 /* the producer has been joined */
+    int consumerWaiting;
+    int producerWaiting;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+};
+
+#define LOAD(ptr)           __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define STORE(ptr, val)     __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+
+/* How long the consumer sleeps between two checks for Ctrl-C */
+#define RKV_PREFETCH_WAIT_MS    100
+
+static void *producerMain(void *arg);
+static void stopProducer(rkv_prefetch_t *prefetch);
+static void wakeUp(rkv_prefetch_t *prefetch, int *waiting,
+                   pthread_cond_t *cond);
+
+rkv_error_t rkv_prefetch_start(kv_store_t *kvstore,
+                               kv_iterator_t *iterator,
+                               int capacity,
+                               rkv_itr_stats_t *stats,
+                               rkv_prefetch_t **ret_prefetch) {
+    rkv_prefetch_t *prefetch = NULL;
+    unsigned long size = 1;
+    rkv_error_t ret;
+
+    if (!kvstore || !iterator || capacity <= 0 || !ret_prefetch) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    /* round up to a power of 2 so that the indexes can be masked */
+    while (size < (unsigned long)capacity) {
+        size <<= 1;
+    }
+
+    ret = rkv_malloc(sizeof(rkv_prefetch_t), (void**)&prefetch);
+    RETURN_IF_ERR(ret);
+    ret = rkv_malloc(sizeof(rkv_prefetch_slot_t) * size,
+                     (void**)&prefetch->slots);
+    if (ret != RKV_SUCCESS) {
+        free(prefetch);
+        return ret;
+    }
+    prefetch->kvstore = kvstore;
+    prefetch->iterator = iterator;
+    prefetch->stats = stats;
+    prefetch->mask = size - 1;
+    pthread_mutex_init(&prefetch->lock, NULL);
+    pthread_cond_init(&prefetch->notEmpty, NULL);
+    pthread_cond_init(&prefetch->notFull, NULL);
+
+    if (pthread_create(&prefetch->thread, NULL, producerMain,
+                       prefetch) != 0) {
+        pthread_cond_destroy(&prefetch->notFull);
+        pthread_cond_destroy(&prefetch->notEmpty);
+        pthread_mutex_destroy(&prefetch->lock);
+        free(prefetch->slots);
+        free(prefetch);
+        return RKV_ERROR;
+    }
+
+    *ret_prefetch = prefetch;
+    return RKV_SUCCESS;
+}
+
+/*
+ * Pop the next record, the caller owns the returned key and value.
+ * Returns RKV_NO_MORE_DATA once the iterator is exhausted. A wait for the
+ * producer can be interrupted with Ctrl-C, the producer is then stopped
+ * and RKV_INTERRUPTED is returned from then on.
+ */
+rkv_error_t rkv_prefetch_next(rkv_prefetch_t *prefetch,
+                              kv_key_t **ret_key,
+                              kv_value_t **ret_value) {
+    rkv_prefetch_slot_t *slot;
+    unsigned long head;
+
+    if (!prefetch || !ret_key) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    head = prefetch->head;
+    while (head == LOAD(&prefetch->tail)) {
+        int done = LOAD(&prefetch->done);
+        if (done != RKV_SUCCESS) {
+            /* the producer may have pushed more before it stopped */
+            if (head == LOAD(&prefetch->tail)) {
+                return done;
+            }
+            break;
+        }
+        pthread_mutex_lock(&prefetch->lock);
+        STORE(&prefetch->consumerWaiting, 1);
+        if (head == LOAD(&prefetch->tail) &&
+            LOAD(&prefetch->done) == RKV_SUCCESS) {
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += RKV_PREFETCH_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&prefetch->notEmpty, &prefetch->lock,
+                                   &deadline);
+        }
+        STORE(&prefetch->consumerWaiting, 0);
+        pthread_mutex_unlock(&prefetch->lock);
+
+        if (head == LOAD(&prefetch->tail) &&
+            LOAD(&prefetch->done) == RKV_SUCCESS && checkInterrupt()) {
+            stopProducer(prefetch);
+            STORE(&prefetch->done, RKV_INTERRUPTED);
+            return RKV_INTERRUPTED;
+        }
+    }
+
+    slot = &prefetch->slots[head & prefetch->mask];
+    *ret_key = slot->key;
+    if (ret_value) {
+        *ret_value = slot->value;
+    } else if (slot->value != NULL) {
+        kv_release_value(&slot->value);
+    }
+    slot->key = NULL;
+    slot->value = NULL;
+    STORE(&prefetch->head, head + 1);
+    wakeUp(prefetch, &prefetch->producerWaiting, &prefetch->notFull);
+    return RKV_SUCCESS;
+}
+
+/* Stop the producer and release the records it has read ahead. */
+void rkv_prefetch_release(rkv_prefetch_t *prefetch) {
+    unsigned long i, tail;
+
+    if (prefetch == NULL) {
+        return;
+    }
+    stopProducer(prefetch);
+
+    tail = LOAD(&prefetch->tail);
+    for (i = prefetch->head; i != tail; i++) {
+        rkv_prefetch_slot_t *slot = &prefetch->slots[i & prefetch->mask];
+        if (slot->key != NULL) {
+            kv_release_key(&slot->key);
+        }
+        if (slot->value != NULL) {
+            kv_release_value(&slot->value);
+        }
+    }
+    pthread_cond_destroy(&prefetch->notFull);
+    pthread_cond_destroy(&prefetch->notEmpty);
+    pthread_mutex_destroy(&prefetch->lock);
+    free(prefetch->slots);
+    free(prefetch);
+}
+
+/*
+ * Ask the producer to stop and wait for it, it finishes the kv call it is
+ * in and detaches from the JVM before it exits.
+ */
+static void stopProducer(rkv_prefetch_t *prefetch) {
+    if (prefetch->joined) {
+        return;
+    }
+    STORE(&prefetch->stop, 1);
+    pthread_mutex_lock(&prefetch->lock);
+    pthread_cond_signal(&prefetch->notFull);
+    pthread_mutex_unlock(&prefetch->lock);
+    pthread_join(prefetch->thread, NULL);
+    prefetch->joined = 1;
+}
+
+static void *producerMain(void *arg) {
+    rkv_prefetch_t *prefetch = (rkv_prefetch_t *)arg;
+    unsigned long tail = 0;
+    int attached = (r_kv_attach_thread() == RKV_SUCCESS);
+    rkv_error_t ret = attached ? RKV_SUCCESS : RKV_ERROR;
+
+    while (ret == RKV_SUCCESS && !LOAD(&prefetch->stop)) {
+        const kv_key_t *key = NULL;
+        const kv_value_t *value = NULL;
+        rkv_prefetch_slot_t *slot;
+        kv_error_t err;
+
+        /* wait for a free slot */
+        if (tail - LOAD(&prefetch->head) > prefetch->mask) {
+            pthread_mutex_lock(&prefetch->lock);
+            STORE(&prefetch->producerWaiting, 1);
+            if (tail - LOAD(&prefetch->head) > prefetch->mask &&
+                !LOAD(&prefetch->stop)) {
+                pthread_cond_wait(&prefetch->notFull, &prefetch->lock);
+            }
+            STORE(&prefetch->producerWaiting, 0);
+            pthread_mutex_unlock(&prefetch->lock);
+            continue;
+        }
+
+        ret = r_kv_iterator_next_stats(prefetch->iterator, &key, &value,
+                                       prefetch->stats);
+        if (ret != RKV_SUCCESS) {
+            break;
+        }
+
+        /* the records returned by the iterator are only valid until the
+           next call, keep copies owned by the ring */
+        slot = &prefetch->slots[tail & prefetch->mask];
+        err = kv_create_key_from_uri_copy(prefetch->kvstore, &slot->key,
+                                          kv_get_key_uri(key));
+        if (err == KV_SUCCESS && value != NULL) {
+            err = kv_create_value_copy(prefetch->kvstore, &slot->value,
+                                       kv_get_value(value),
+                                       kv_get_value_size(value));
+        }
+        if (err != KV_SUCCESS) {
+            if (slot->key != NULL) {
+                kv_release_key(&slot->key);
+            }
+            ret = RKV_NO_MEMORY;
+            break;
+        }
+        STORE(&prefetch->tail, ++tail);
+        wakeUp(prefetch, &prefetch->consumerWaiting, &prefetch->notEmpty);
+    }
+
+    if (ret == RKV_SUCCESS) {
+        ret = RKV_NO_MORE_DATA;
+    }
+    pthread_mutex_lock(&prefetch->lock);
+    STORE(&prefetch->done, ret);
+    pthread_cond_signal(&prefetch->notEmpty);
+    pthread_mutex_unlock(&prefetch->lock);
+    if (attached) {
+        r_kv_detach_thread();
+    }
+    return NULL;
+}
+
+static void wakeUp(rkv_prefetch_t *prefetch, int *waiting,
+                   pthread_cond_t *cond) {
+    if (LOAD(waiting)) {
+        pthread_mutex_lock(&prefetch->lock);
+        pthread_cond_signal(cond);
+        pthread_mutex_unlock(&prefetch->lock);
+    }
+}
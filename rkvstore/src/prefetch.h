@@ -0,0 +1,64 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <kvstore.h>
+#include "rkverr.h"
+#include "rkvstore_internal.h"
+
+typedef struct rkv_prefetch rkv_prefetch_t;
+
+rkv_error_t rkv_prefetch_start(kv_store_t *kvstore,
+                               kv_iterator_t *iterator,
+                               int capacity,
+                               rkv_itr_stats_t *stats,
+                               rkv_prefetch_t **ret_prefetch);
+rkv_error_t rkv_prefetch_next(rkv_prefetch_t *prefetch,
+                              kv_key_t **ret_key,
+                              kv_value_t **ret_value);
+void rkv_prefetch_release(rkv_prefetch_t *prefetch);
+
+#endif
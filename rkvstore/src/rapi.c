@@ -50,26 +50,48 @@
 #include "symbols.h"
 
 static const R_CallMethodDef callMethods[] = {
-    {".rkv_open_store", (DL_FUNC)rkv_open_store, 4},
+    {".rkv_open_store", (DL_FUNC)rkv_open_store, 6},
     {".rkv_close_store", (DL_FUNC)rkv_close_store, 1},
+    {".rkv_shutdown", (DL_FUNC)rkv_shutdown, 0},
+    {".rkv_refresh_schemas", (DL_FUNC)rkv_refresh_schemas, 1},
     {".rkv_create_key", (DL_FUNC)rkv_create_key, 3},
     {".rkv_create_key_from_uri", (DL_FUNC)rkv_create_key_from_uri, 2},
     {".rkv_get_key_uri", (DL_FUNC)rkv_get_key_uri, 1},
     /*{".rkv_get_key_major", (DL_FUNC)rkv_get_key_major, 1},
     {".rkv_get_key_minor", (DL_FUNC)rkv_get_key_minor, 1}, */
     {".rkv_release_key", (DL_FUNC)rkv_release_key, 1},
-    {".rkv_create_value", (DL_FUNC)rkv_create_value, 2},
-    {".rkv_get_value", (DL_FUNC)rkv_get_value, 1},
+    {".rkv_create_keys", (DL_FUNC)rkv_create_keys, 2},
+    {".rkv_keys_length", (DL_FUNC)rkv_keys_length, 1},
+    {".rkv_release_keys", (DL_FUNC)rkv_release_keys, 1},
+    {".rkv_create_value", (DL_FUNC)rkv_create_value, 3},
+    {".rkv_get_value", (DL_FUNC)rkv_get_value, 2},
     {".rkv_get_avro_value", (DL_FUNC)rkv_get_avro_value, 1},
+    {".rkv_get_avro_list", (DL_FUNC)rkv_get_avro_list, 1},
+    {".rkv_get_many_avro_list", (DL_FUNC)rkv_get_many_avro_list, 2},
     {".rkv_release_value", (DL_FUNC)rkv_release_value, 1},
-    {".rkv_put", (DL_FUNC)rkv_put, 3},
+    {".rkv_put", (DL_FUNC)rkv_put, 4},
     {".rkv_get", (DL_FUNC)rkv_get, 2},
+    {".rkv_get_raw", (DL_FUNC)rkv_get_raw, 2},
+    {".rkv_set_compression", (DL_FUNC)rkv_set_compression, 2},
+    {".rkv_put_object", (DL_FUNC)rkv_put_object, 4},
+    {".rkv_get_object", (DL_FUNC)rkv_get_object, 2},
+    {".rkv_put_lob", (DL_FUNC)rkv_put_lob, 3},
+    {".rkv_get_lob", (DL_FUNC)rkv_get_lob, 2},
+    {".rkv_delete_lob", (DL_FUNC)rkv_delete_lob, 2},
     {".rkv_delete", (DL_FUNC)rkv_delete, 2},
+    {".rkv_get_many", (DL_FUNC)rkv_get_many, 3},
+    {".rkv_delete_many", (DL_FUNC)rkv_delete_many, 2},
     {".rkv_multi_delete", (DL_FUNC)rkv_multi_delete, 4},
-    {".rkv_multiget_values", (DL_FUNC)rkv_multiget_values, 5},
-    {".rkv_multiget_iterator", (DL_FUNC)rkv_multiget_iterator, 5},
-    {".rkv_store_iterator", (DL_FUNC)rkv_store_iterator, 5},
+    {".rkv_put_dataframe", (DL_FUNC)rkv_put_dataframe, 4},
+    {".rkv_multiget_values", (DL_FUNC)rkv_multiget_values, 7},
+    {".rkv_store_values", (DL_FUNC)rkv_store_values, 7},
+    {".rkv_aggregate", (DL_FUNC)rkv_aggregate, 6},
+    {".rkv_sample_values", (DL_FUNC)rkv_sample_values, 5},
+    {".rkv_count", (DL_FUNC)rkv_count, 6},
+    {".rkv_multiget_iterator", (DL_FUNC)rkv_multiget_iterator, 9},
+    {".rkv_store_iterator", (DL_FUNC)rkv_store_iterator, 10},
     {".rkv_iterator_next", (DL_FUNC)rkv_iterator_next, 1},
+    {".rkv_iterator_next_batch", (DL_FUNC)rkv_iterator_next_batch, 5},
     {".rkv_iterator_get_key", (DL_FUNC)rkv_iterator_get_key, 1},
     {".rkv_iterator_get_value", (DL_FUNC)rkv_iterator_get_value, 1},
     {".rkv_iterator_size", (DL_FUNC)rkv_iterator_size, 1},
@@ -53,9 +53,19 @@ typedef enum {
     RKV_INVALID_SCHEMA = -4,
     RKV_INVALID_AVRO_SET_OP = -5,
     RKV_VALUE_NOT_AVRO = -6,
+    RKV_INVALID_COLUMN_TYPE = -7,
+    RKV_INVALID_COLUMN = -8,
+    RKV_INVALID_FILTER = -9,
+    RKV_CORRUPT_VALUE = -10,
+    RKV_VALUE_NOT_LOB = -11,
+    RKV_STORES_OPEN = -12,
+    RKV_VALUE_OUT_OF_RANGE = -13,
+    RKV_INTERRUPTED = -14,
+    RKV_JVM_SHUT_DOWN = -15,
     RKV_ERROR = -100,
     RKV_NO_MORE_DATA = 1,
-    RKV_KEY_NOT_FOUND = 2
+    RKV_KEY_NOT_FOUND = 2,
+    RKV_FILTERED_OUT = 3
 } rkv_error_t;
 
 #endif
@@ -42,35 +42,132 @@
  */
 
 
+#include <limits.h>
 #include <R.h>
 
 #include "symbols.h"
 #include "utils.h"
 #include "rkvstore.h"
 #include "rkvstore_internal.h"
-
-#define CLASS_KVSTORE   "kvstore"
+#include "dataframe.h"
+#include "prefetch.h"
+#include "filter.h"
+#include "aggregate.h"
+#include "avrolist.h"
+#include "codec.h"
 
 typedef struct rkv_iterator {
     kv_iterator_t * kvIterator;
     kv_key_t * currentKey;
     kv_value_t * currentValue;
+    /* only compared, the store may have been closed */
+    const rkv_store_t * store;
+    int isKeyOnly;
+    int isMultiGet;
+    rkv_itr_stats_t stats;
+    /* read-ahead mode: the current key/value are owned copies */
+    rkv_prefetch_t * prefetch;
+    struct rkv_iterator * nextPrefetching;
+    rkv_error_t sizeErr;
+    int size;
 }rkv_iterator_t;
 
-typedef struct {
-    char *name;
-    avro_type_t type;
-}rkv_avro_field;
+/*
+ * The iterators with a producer thread, which uses the kv store on its
+ * own: they are stopped before their store is closed.
+ */
+static rkv_iterator_t *prefetchingIterators = NULL;
+
+/* A key kept by the sampling, index is its position in the key order */
+typedef struct rkv_sample_key {
+    int index;
+    kv_key_t * key;
+}rkv_sample_key_t;
+
+/* The state of rkv_put_object and rkv_get_object, released on errors too */
+typedef struct rkv_object_ctx {
+    kv_store_t * kvstore;
+    kv_key_t * key;
+    SEXP object;
+    int threshold;
+    rkv_codec_writer_t * writer;
+    rkv_codec_reader_t * reader;
+    kv_value_t * value;
+    rkv_error_t ret;
+}rkv_object_ctx_t;
+
+/* The keys of a kvkeyvector, NULL for the URIs that are not valid */
+typedef struct rkv_key_vector {
+    kv_key_t ** keys;
+    R_xlen_t nKeys;
+}rkv_key_vector_t;
+
+/* The keys of the batch APIs: a character vector of URIs or a kvkeyvector */
+typedef struct rkv_batch_keys {
+    kv_store_t * kvstore;
+    SEXP uris;
+    /* the keys of a kvkeyvector are borrowed, not released per batch */
+    rkv_key_vector_t * vector;
+    R_xlen_t nKeys;
+}rkv_batch_keys_t;
 
 static SEXP makeExternalInt(int value);
 static SEXP makeExternalReal(double value);
+static SEXP makeExternalInteger64(int64_t value);
 static SEXP makeExternalLogic(int value);
 static SEXP makeExternalString(const char *data[], int len[], int size);
-static SEXP makeExternalPtr(void *ptr, SEXP symbol, const char *cls_name,
+static SEXP makeExternalRaw(const kv_value_t *value);
+static int getCompressThreshold(rkv_store_t *store, SEXP compress);
+static rkv_error_t compressValue(kv_store_t *kvstore,
+                                 const unsigned char *data, int size,
+                                 int threshold, kv_value_t **ret_value);
+static SEXP makeExternalPtr(void *ptr, SEXP symbol, SEXP cls,
                             R_CFinalizer_t finalizer);
+static SEXP scanValues(SEXP store, SEXP schema, SEXP key,
+                       SEXP start, SEXP end, SEXP columns, SEXP filter,
+                       int isMultiGet);
+static int getSampleSize(int nRecs, double percentage, int limit);
+static rkv_error_t sampleKeys(kv_store_t *kvstore, kv_iterator_t *iterator,
+                              double percentage, int limit,
+                              rkv_sample_key_t **ret_sample,
+                              int *ret_nSample, int *ret_nKept);
+static int compareSampleKeys(const void *a, const void *b);
+static rkv_error_t fetchSample(rkv_store_t *rkvStore,
+                               const rkv_sample_key_t *sample, int nSample,
+                               rkv_frame_t *frame);
+static rkv_filter_t *getFilter(SEXP filter);
+static SEXP putObject(void *data);
+static SEXP getObject(void *data);
+static rkv_error_t serializeObject(rkv_object_ctx_t *ctx, size_t threshold,
+                                   const unsigned char **ret_data,
+                                   size_t *ret_size);
+static void releaseObjectCtx(void *data);
+static void outObjectChar(R_outpstream_t stream, int c);
+static void outObjectBytes(R_outpstream_t stream, void *buf, int n);
+static int inObjectChar(R_inpstream_t stream);
+static void inObjectBytes(R_inpstream_t stream, void *buf, int n);
+static rkv_error_t getLobManifest(kv_store_t *kvstore, const kv_key_t *key,
+                                  rkv_lob_manifest_t *manifest);
+static rkv_error_t createChunkKeys(kv_store_t *kvstore, const char *uri,
+                                   unsigned int generation, int first, int n,
+                                   kv_key_t **keys);
+static void releaseChunkKeys(kv_key_t **keys, int n);
+static rkv_error_t kvValueToList(const kv_value_t *kvValue, SEXP *ret_obj);
+static void deleteLobChunks(rkv_store_t *store, const char *uri,
+                            unsigned int generation, int first, int last);
 static SEXP createIteartorInternal(SEXP store, SEXP key,
-            SEXP start, SEXP end, SEXP keyonly, int isMultiGet);
-static rkv_iterator_t *rkv_itr_init(kv_iterator_t *iterator);
+            SEXP start, SEXP end, SEXP keyonly, SEXP prefetch,
+            SEXP batchSize, SEXP depth, SEXP startInclusive,
+            SEXP endInclusive, int isMultiGet);
+static rkv_iterator_t *rkv_itr_init(kv_iterator_t *iterator,
+                                     const rkv_store_t *store,
+                                     int isKeyOnly, int isMultiGet);
+static void stopPrefetch(rkv_iterator_t *rkvIterator);
+static void stopStorePrefetches(const rkv_store_t *store);
+static kv_depth_t getDepth(SEXP depth);
+static rkv_error_t rkv_itr_next(rkv_iterator_t *rkvIterator,
+                                const kv_key_t **ret_key,
+                                const kv_value_t **ret_value);
 static kv_iterator_t *rkv_itr_get_kvIterator(rkv_iterator_t * rkvIterator);
 static void rkv_itr_set_key_value(rkv_iterator_t * rkvIterator,
                                   const kv_key_t *key,
@@ -79,20 +176,32 @@ static kv_key_t *rkv_itr_get_currentKey(rkv_iterator_t * rkvIterator);
 static kv_value_t *rkv_itr_get_currentValue(rkv_iterator_t * rkvIterator);
 static kv_iterator_t *get_kvIterator_from_Obj(SEXP iterator,
                                     rkv_iterator_t ** ret_rkvIterator);
+static rkv_store_t *getIteratorStore(SEXP iterator);
 
 static void rkvStoreFinalizer(SEXP ptr);
 static void rkvKeyFinalizer(SEXP ptr);
+static void rkvKeyVectorFinalizer(SEXP ptr);
+static void releaseKeyVector(rkv_key_vector_t *vector);
+static void getBatchKeys(kv_store_t *kvstore, SEXP keys, const char *name,
+                         rkv_batch_keys_t *ret_keys);
+static void nextBatchKeys(const rkv_batch_keys_t *batchKeys, R_xlen_t offset,
+                          int n, kv_key_t **ret_keys);
+static void releaseBatchKey(const rkv_batch_keys_t *batchKeys,
+                            kv_key_t **key);
 static void rkvValueFinalizer(SEXP ptr);
 static void rkvIteratorFinalizer(SEXP ptr);
 static void rkvAvroValueFinalizer(SEXP ptr);
 static void release_rkvItearator(rkv_iterator_t *rkvIterator);
-static void release_avro_fields (rkv_avro_field *fields, int nFields);
+static char *splitSchemaName(SEXP schema, const char **ret_space,
+                             const char **ret_name);
 
-SEXP rkv_open_store(SEXP kvclient_jar, SEXP host, SEXP port, SEXP kvname) {
-    kv_store_t *store = NULL;
+SEXP rkv_open_store(SEXP kvclient_jar, SEXP host, SEXP port, SEXP kvname,
+                    SEXP workers, SEXP jvmOptions) {
+    rkv_store_t *store = NULL;
     kv_error_t err;
     const char *l_host, *l_kvname, *kvclient_path_to_jar;
-    int l_port;
+    char *l_jvm_options = NULL;
+    int l_port, l_workers;
 
     /* Check input parameters */
     if (!isValidString(host) || STRING_ELT(host, 0) == NA_STRING) {
@@ -112,12 +221,44 @@ SEXP rkv_open_store(SEXP kvclient_jar, SEXP host, SEXP port, SEXP kvname) {
     }
     kvclient_path_to_jar = CHAR(STRING_ELT(kvclient_jar, 0));
 
-    err = r_kvstore_open(kvclient_path_to_jar, l_kvname, 
-                         l_host, l_port, &store);
+    l_workers = asInteger(workers);
+    if (l_workers == NA_INTEGER || l_workers < 0) {
+        ERROR_INVALID_ARGUMENT("workers");
+    }
+
+    /* The options are joined with spaces, e.g. c("-Xmx4g", "-XX:+UseG1GC") */
+    if (!isNull(jvmOptions)) {
+        size_t len = 1;
+        int i;
+
+        if (!isString(jvmOptions)) {
+            ERROR_INVALID_ARGUMENT("jvm_options");
+        }
+        for (i = 0; i < LENGTH(jvmOptions); i++) {
+            if (STRING_ELT(jvmOptions, i) == NA_STRING) {
+                ERROR_INVALID_ARGUMENT("jvm_options");
+            }
+            len += LENGTH(STRING_ELT(jvmOptions, i)) + 1;
+        }
+        l_jvm_options = R_alloc(len, sizeof(char));
+        l_jvm_options[0] = '\0';
+        for (i = 0; i < LENGTH(jvmOptions); i++) {
+            if (i > 0) {
+                strcat(l_jvm_options, " ");
+            }
+            strcat(l_jvm_options, CHAR(STRING_ELT(jvmOptions, i)));
+        }
+    }
+
+    err = r_kvstore_open(kvclient_path_to_jar, l_jvm_options, l_kvname,
+                         l_host, l_port, l_workers, &store);
+    if (err == RKV_JVM_SHUT_DOWN) {
+        error("%s", getRKVStoreErrStr(err));
+    }
     if (err != KV_SUCCESS) {
         return R_NilValue;
     }
-    return makeExternalPtr(store, sym_kvstore, CLASS_KVSTORE,
+    return makeExternalPtr(store, sym_kvstore, cls_kvstore,
                            rkvStoreFinalizer);
 }
 
@@ -125,19 +266,41 @@ static void rkvStoreFinalizer(SEXP ptr) {
     if (!R_ExternalPtrAddr(ptr)) {
         return;
     }
-    r_kvstore_close((kv_store_t *)R_ExternalPtrAddr(ptr));
+    stopStorePrefetches((rkv_store_t *)R_ExternalPtrAddr(ptr));
+    r_kvstore_close((rkv_store_t *)R_ExternalPtrAddr(ptr));
     R_ClearExternalPtr(ptr);
 }
 
 SEXP rkv_close_store(SEXP store) {
-    kv_store_t *kvstore = getKVStore(store);
+    rkv_store_t *kvstore = getRKVStore(store);
+
+    stopStorePrefetches(kvstore);
 #if DEBUG
     kv_error_t err = r_kvstore_close(kvstore);
     PRINTF("rkv_close_store, ret = %d.\n", err);
 #else
     r_kvstore_close(kvstore);
 #endif
-    R_ClearExternalPtr(getAttrib(store, sym_kvstore));
+    R_ClearExternalPtr(store);
+    return R_NilValue;
+}
+
+/*
+ * Release the JVM at the end of the session, the stores that are no
+ * longer referenced are collected first so that their finalizers close
+ * them. No store can be opened after.
+ */
+SEXP rkv_shutdown(void) {
+    rkv_error_t err;
+
+    R_gc();
+    err = r_kvstore_shutdown();
+    RETURN_NULL_IF_ERR(err);
+    return makeExternalLogic(1);
+}
+
+SEXP rkv_refresh_schemas(SEXP store) {
+    r_kv_invalidate_schemas(getRKVStore(store));
     return R_NilValue;
 }
 
@@ -185,7 +348,7 @@ SEXP rkv_create_key(SEXP store, SEXP major, SEXP minor) {
     err = r_kv_create_key(kvstore, &key, (const char**)p_major,
                          (const char**)p_minor);
     CLEANUP_IF_RERR(err);
-    ret = makeExternalPtr(key, sym_kv_key, CLASS_KV_KEY, rkvKeyFinalizer);
+    ret = makeExternalPtr(key, sym_kv_key, cls_kv_key, rkvKeyFinalizer);
 
 Cleanup:
     if (p_major != (char**)&buf) {
@@ -208,7 +371,7 @@ SEXP rkv_create_key_from_uri(SEXP store, SEXP uri) {
     err = kv_create_key_from_uri(kvstore, &kvkey, pbuf);
     RETURN_NULL_IF_ERR(err);
 
-    ret = makeExternalPtr(kvkey, sym_kv_key, CLASS_KV_KEY, rkvKeyFinalizer);
+    ret = makeExternalPtr(kvkey, sym_kv_key, cls_kv_key, rkvKeyFinalizer);
     return ret;
 }
 
@@ -258,37 +421,142 @@ static void rkvKeyFinalizer(SEXP ptr) {
 SEXP rkv_release_key(SEXP key) {
     kv_key_t * kkey = getKey(key);
     r_kv_release_key(&kkey);
-    R_ClearExternalPtr(getAttrib(key, sym_kv_key));
+    R_ClearExternalPtr(key);
     return R_NilValue;
 }
 
-SEXP rkv_create_value(SEXP store, SEXP data) {
+/*
+ * Create the keys of a character vector of URIs in one native block, the
+ * kvkeyvector has a single finalizer whatever the number of keys. A NA or
+ * invalid URI leaves a NULL key, the batch APIs report it as failed.
+ */
+SEXP rkv_create_keys(SEXP store, SEXP uris) {
     kv_store_t *kvstore = NULL;
-    kv_value_t *value = NULL;
+    rkv_key_vector_t *vector = NULL;
+    R_xlen_t i;
     rkv_error_t err;
 
     kvstore = getKVStore(store);
-    if (!isNull(data) && checkObjHasClass(data, CLASS_KV_AVRO_VALUE)) {
+    if (!isString(uris)) {
+        ERROR_INVALID_STRING("uris");
+    }
+
+    err = rkv_malloc(sizeof(rkv_key_vector_t), (void **)&vector);
+    RETURN_NULL_IF_ERR(err);
+    vector->nKeys = XLENGTH(uris);
+    if (vector->nKeys > 0) {
+        vector->keys = calloc(vector->nKeys, sizeof(kv_key_t *));
+        if (vector->keys == NULL) {
+            free(vector);
+            RETURN_NULL_IF_ERR(RKV_NO_MEMORY);
+        }
+    }
+    for (i = 0; i < vector->nKeys; i++) {
+        SEXP uri = STRING_ELT(uris, i);
+        if (uri != NA_STRING) {
+            r_kv_create_key_from_uri(kvstore, &vector->keys[i], CHAR(uri));
+        }
+    }
+    return makeExternalPtr(vector, sym_kv_key_vector, cls_kv_key_vector,
+                           rkvKeyVectorFinalizer);
+}
+
+SEXP rkv_keys_length(SEXP keys) {
+    rkv_key_vector_t *vector = (rkv_key_vector_t *)getKeyVector(keys);
+    return makeExternalReal((double)vector->nKeys);
+}
+
+SEXP rkv_release_keys(SEXP keys) {
+    releaseKeyVector((rkv_key_vector_t *)getKeyVector(keys));
+    R_ClearExternalPtr(keys);
+    return R_NilValue;
+}
+
+static void rkvKeyVectorFinalizer(SEXP ptr) {
+    if (!R_ExternalPtrAddr(ptr))
+        return;
+    releaseKeyVector((rkv_key_vector_t *)R_ExternalPtrAddr(ptr));
+    R_ClearExternalPtr(ptr);
+}
+
+static void releaseKeyVector(rkv_key_vector_t *vector) {
+    R_xlen_t i;
+
+    for (i = 0; i < vector->nKeys; i++) {
+        if (vector->keys[i] != NULL) {
+            r_kv_release_key(&vector->keys[i]);
+        }
+    }
+    free(vector->keys);
+    free(vector);
+}
+
+SEXP rkv_create_value(SEXP store, SEXP data, SEXP compress) {
+    rkv_store_t *rkvStore = NULL;
+    kv_store_t *kvstore = NULL;
+    kv_value_t *value = NULL;
+    int threshold;
+    rkv_error_t err;
+    SEXP ret;
+
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
+    threshold = getCompressThreshold(rkvStore, compress);
+    if (!isNull(data) && isKVObject(data, sym_kv_avro_value)) {
         avro_value_t *avro_value = getAvroValue(data);
         err = r_kv_create_value_avro(kvstore, &value, avro_value);
+    } else if (TYPEOF(data) == RAWSXP) {
+        err = compressValue(kvstore, RAW(data), LENGTH(data), threshold,
+                            &value);
+        RETURN_NULL_IF_ERR(err);
+        if (value == NULL) {
+            /* No copy, the handle keeps the raw vector alive unmodified */
+            err = r_kv_wrap_value_bytes(kvstore, &value, RAW(data),
+                                        LENGTH(data));
+            RETURN_NULL_IF_ERR(err);
+            ret = makeExternalPtr(value, sym_kv_value, cls_kv_value,
+                                  rkvValueFinalizer);
+            MARK_NOT_MUTABLE(data);
+            R_SetExternalPtrProtected(ret, data);
+            return ret;
+        }
     } else {
         const unsigned char *pbuf;
+        int len;
+
         CHECK_IF_VALID_STRING(data, "data");
         pbuf = (const unsigned char *)CHAR(STRING_ELT(data, 0));
-        err = r_kv_create_value_bytes(kvstore, &value, pbuf,
-                                     (int)strlen((const char*)pbuf));
+        len = (int)strlen((const char*)pbuf);
+        err = compressValue(kvstore, pbuf, len, threshold, &value);
+        if (err == RKV_SUCCESS && value == NULL) {
+            err = r_kv_create_value_bytes(kvstore, &value, pbuf, len);
+        }
     }
     RETURN_NULL_IF_ERR(err);
-    return makeExternalPtr(value, sym_kv_value, CLASS_KV_VALUE,
+    return makeExternalPtr(value, sym_kv_value, cls_kv_value,
                            rkvValueFinalizer);
 }
 
-SEXP rkv_get_value(SEXP value) {
+SEXP rkv_get_value(SEXP value, SEXP raw) {
     rkv_error_t ret;
     char *pBuf = NULL;
     int len = 0, needFree = 0;
     kv_value_t * kvValue = getValue(value);
 
+    CHECK_IF_LOGICAL(raw, "raw");
+    if (LOGICAL(raw)[0]) {
+        return makeExternalRaw(kvValue);
+    }
+    if (rkv_codec_is_compressed(kv_get_value(kvValue),
+                                kv_get_value_size(kvValue))) {
+        SEXP bytes = PROTECT(makeExternalRaw(kvValue));
+        const char *data = (const char *)RAW(bytes);
+
+        len = LENGTH(bytes);
+        bytes = makeExternalString(&data, &len, 1);
+        UNPROTECT(1);
+        return bytes;
+    }
     ret = r_kv_get_value(kvValue, (const unsigned char**)&pBuf, &len, &needFree);
     RETURN_NULL_IF_ERR(ret);
     SEXP retVal = makeExternalString((const char **)&pBuf, &len, 1);
@@ -306,10 +574,77 @@ SEXP rkv_get_avro_value(SEXP value) {
     ret = r_kv_get_avrovalue(kvValue, &avroValue, NULL);
     RETURN_NULL_IF_ERR(ret);
     return makeExternalPtr(avroValue, sym_kv_avro_value,
-                           CLASS_KV_AVRO_VALUE,
+                           cls_kv_avro_value,
                            rkvAvroValueFinalizer);
 }
 
+/* The R list of an avro value, or of the avro record in a kvValue */
+SEXP rkv_get_avro_list(SEXP value) {
+    SEXP obj = R_NilValue;
+    rkv_error_t ret;
+
+    if (!isNull(value) && isKVObject(value, sym_kv_avro_value)) {
+        ret = rkv_avro_to_r(getAvroValue(value), &obj);
+    } else {
+        ret = kvValueToList(getValue(value), &obj);
+    }
+    RETURN_NULL_IF_ERR(ret);
+    return obj;
+}
+
+/*
+ * The R lists of the avro records of many keys, got concurrently by
+ * batches. The element of a key that is missing or not avro is NULL.
+ */
+SEXP rkv_get_many_avro_list(SEXP store, SEXP uris) {
+    rkv_store_t *rkvStore = NULL;
+    rkv_batch_keys_t batchKeys;
+    kv_key_t *keys[RKV_BATCH_SIZE];
+    kv_value_t *values[RKV_BATCH_SIZE];
+    rkv_error_t errs[RKV_BATCH_SIZE];
+    int nBatch = 0, i;
+    R_xlen_t nKeys, iKey;
+    SEXP lists, obj;
+
+    rkvStore = getRKVStore(store);
+    getBatchKeys(rkvStore->kvstore, uris, "uris", &batchKeys);
+    nKeys = batchKeys.nKeys;
+
+    PROTECT(lists = allocVector(VECSXP, nKeys));
+    for (iKey = 0; iKey < nKeys; iKey += nBatch) {
+        nBatch = (nKeys - iKey < RKV_BATCH_SIZE) ?
+                 (int)(nKeys - iKey) : RKV_BATCH_SIZE;
+
+        nextBatchKeys(&batchKeys, iKey, nBatch, keys);
+        r_kv_get_batch(rkvStore, keys, values, errs, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            if (errs[i] == RKV_SUCCESS &&
+                kvValueToList(values[i], &obj) == RKV_SUCCESS) {
+                SET_VECTOR_ELT(lists, iKey + i, obj);
+            }
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+            releaseBatchKey(&batchKeys, &keys[i]);
+        }
+    }
+    UNPROTECT(1);
+    return lists;
+}
+
+static rkv_error_t kvValueToList(const kv_value_t *kvValue, SEXP *ret_obj) {
+    avro_value_t avroValue;
+    rkv_error_t ret;
+
+    if (r_kv_read_avrovalue(kvValue, &avroValue, NULL) != RKV_SUCCESS) {
+        return RKV_VALUE_NOT_AVRO;
+    }
+    ret = rkv_avro_to_r(&avroValue, ret_obj);
+    avro_value_decref(&avroValue);
+    return ret;
+}
+
 static void rkvValueFinalizer(SEXP ptr) {
     kv_value_t *value = NULL;
     if (!R_ExternalPtrAddr(ptr))
@@ -322,21 +657,39 @@ static void rkvValueFinalizer(SEXP ptr) {
 SEXP rkv_release_value(SEXP value) {
     kv_value_t * kvalue = getValue(value);
     r_kv_release_value(&kvalue);
-    R_ClearExternalPtr(getAttrib(value, sym_kv_value));
+    R_ClearExternalPtr(value);
+    R_SetExternalPtrProtected(value, R_NilValue);
     return R_NilValue;
 }
 
-SEXP rkv_put(SEXP store, SEXP key, SEXP value) {
+SEXP rkv_put(SEXP store, SEXP key, SEXP value, SEXP compress) {
+    rkv_store_t *rkvStore = NULL;
     kv_store_t *kvstore = NULL;
     kv_key_t *kvKey = NULL;
     kv_value_t *kvValue = NULL;
     rkv_error_t ret;
 
-    kvstore = getKVStore(store);
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
     kvKey = getKey(key);
-    kvValue = getValue(value);
 
-    ret = r_kv_put(kvstore, kvKey, kvValue, NULL);
+    if (TYPEOF(value) == RAWSXP) {
+        /* Unless compressed, the value wraps the raw vector during the put */
+        ret = compressValue(kvstore, RAW(value), LENGTH(value),
+                            getCompressThreshold(rkvStore, compress),
+                            &kvValue);
+        if (ret == RKV_SUCCESS && kvValue == NULL) {
+            ret = r_kv_wrap_value_bytes(kvstore, &kvValue, RAW(value),
+                                        LENGTH(value));
+        }
+        if (ret == RKV_SUCCESS) {
+            ret = r_kv_put(kvstore, kvKey, kvValue, NULL);
+            r_kv_release_value(&kvValue);
+        }
+    } else {
+        kvValue = getValue(value);
+        ret = r_kv_put(kvstore, kvKey, kvValue, NULL);
+    }
     Rprintf("Operation %s.\n", (ret == RKV_SUCCESS)?"successful":"failed");
 
     return R_NilValue;
@@ -356,119 +709,1177 @@ SEXP rkv_get(SEXP store, SEXP key) {
         Rprintf("The specified key is not not existed.\n");
     }
     RETURN_NULL_IF_ERR(ret);
-    return makeExternalPtr(kvValue, sym_kv_value, CLASS_KV_VALUE,
+    return makeExternalPtr(kvValue, sym_kv_value, cls_kv_value,
                            rkvValueFinalizer);
 }
 
-SEXP rkv_delete(SEXP store, SEXP key) {
+/*
+ * Compress the string and raw values of at least threshold bytes that
+ * are created or put without a compress argument, 0 turns it off.
+ */
+SEXP rkv_set_compression(SEXP store, SEXP threshold) {
+    rkv_store_t *rkvStore = getRKVStore(store);
+    int value = 0;
+
+    if (!isNull(threshold)) {
+        value = asInteger(threshold);
+        if (value == NA_INTEGER || value < 0) {
+            ERROR_INVALID_ARGUMENT("threshold");
+        }
+    }
+    rkvStore->compressThreshold = value;
+    return R_NilValue;
+}
+
+/* NULL follows the store, TRUE compresses from the default threshold */
+static int getCompressThreshold(rkv_store_t *store, SEXP compress) {
+    if (isNull(compress)) {
+        return store->compressThreshold;
+    }
+    CHECK_IF_LOGICAL(compress, "compress");
+    if (!LOGICAL(compress)[0]) {
+        return 0;
+    }
+    return (store->compressThreshold > 0) ? store->compressThreshold :
+           RKV_CODEC_DEFAULT_THRESHOLD;
+}
+
+/* A compressed copy of the data, NULL if it is too small or doesn't shrink */
+static rkv_error_t compressValue(kv_store_t *kvstore,
+                                 const unsigned char *data, int size,
+                                 int threshold, kv_value_t **ret_value) {
+    unsigned char *buf = NULL;
+    size_t bufSize = 0;
+    rkv_error_t ret;
+
+    *ret_value = NULL;
+    if (threshold <= 0 || size < threshold ||
+        (size_t)size > RKV_CODEC_MAX_RAW_SIZE) {
+        return RKV_SUCCESS;
+    }
+    ret = rkv_codec_compress(data, size, &buf, &bufSize);
+    if (ret == RKV_SUCCESS && bufSize < (size_t)size) {
+        ret = r_kv_create_value_bytes(kvstore, ret_value, buf, (int)bufSize);
+    }
+    free(buf);
+    return ret;
+}
+
+/*
+ * Serialize an R object straight into the buffer of the value that is put.
+ * Once it reaches the compression threshold it is deflated as it is written,
+ * and serialized again as is in the rare case it doesn't get smaller.
+ */
+SEXP rkv_put_object(SEXP store, SEXP key, SEXP object, SEXP compress) {
+    rkv_object_ctx_t ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.kvstore = getKVStore(store);
+    ctx.key = getKey(key);
+    ctx.object = object;
+    ctx.threshold = getCompressThreshold(getRKVStore(store), compress);
+
+    R_ExecWithCleanup(putObject, &ctx, releaseObjectCtx, &ctx);
+    RETURN_NULL_IF_ERR(ctx.ret);
+    return makeExternalLogic(1);
+}
+
+/* Unserialize an R object from the bytes of the value, NULL if not found */
+SEXP rkv_get_object(SEXP store, SEXP key) {
+    rkv_object_ctx_t ctx;
+    rkv_error_t ret;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.kvstore = getKVStore(store);
+    ctx.key = getKey(key);
+
+    ret = r_kv_get(ctx.kvstore, ctx.key, &ctx.value);
+    if (ret == RKV_KEY_NOT_FOUND) {
+        return R_NilValue;
+    }
+    RETURN_NULL_IF_ERR(ret);
+    return R_ExecWithCleanup(getObject, &ctx, releaseObjectCtx, &ctx);
+}
+
+static SEXP putObject(void *data) {
+    rkv_object_ctx_t *ctx = (rkv_object_ctx_t *)data;
+    const unsigned char *buf = NULL;
+    size_t size = 0;
+    rkv_error_t ret;
+
+    ret = serializeObject(ctx, (size_t)ctx->threshold, &buf, &size);
+    /* Serialized again as is when deflating didn't pay or can't be read */
+    if (ret == RKV_VALUE_OUT_OF_RANGE ||
+        (ret == RKV_SUCCESS && rkv_codec_writer_grew(ctx->writer))) {
+        ret = serializeObject(ctx, 0, &buf, &size);
+    }
+    if (ret == RKV_SUCCESS && size > INT_MAX) {
+        ret = RKV_INVALID_ARGUEMENTS;
+    }
+    if (ret == RKV_SUCCESS) {
+        ret = r_kv_wrap_value_bytes(ctx->kvstore, &ctx->value, buf,
+                                    (int)size);
+    }
+    if (ret == RKV_SUCCESS) {
+        ret = r_kv_put(ctx->kvstore, ctx->key, ctx->value, NULL);
+    }
+    ctx->ret = ret;
+    return R_NilValue;
+}
+
+/* The writer of the context is replaced by one holding the object */
+static rkv_error_t serializeObject(rkv_object_ctx_t *ctx, size_t threshold,
+                                   const unsigned char **ret_data,
+                                   size_t *ret_size) {
+    struct R_outpstream_st stream;
+    rkv_error_t ret;
+
+    rkv_codec_writer_release(ctx->writer);
+    ctx->writer = NULL;
+    ret = rkv_codec_writer_create(threshold, &ctx->writer);
+    if (ret != RKV_SUCCESS) {
+        error("%s", getRKVStoreErrStr(ret));
+    }
+    R_InitOutPStream(&stream, ctx->writer, R_pstream_xdr_format, 3,
+                     outObjectChar, outObjectBytes, NULL, R_NilValue);
+    R_Serialize(ctx->object, &stream);
+    return rkv_codec_writer_finish(ctx->writer, ret_data, ret_size);
+}
+
+static SEXP getObject(void *data) {
+    rkv_object_ctx_t *ctx = (rkv_object_ctx_t *)data;
+    struct R_inpstream_st stream;
+    rkv_error_t ret;
+
+    ret = rkv_codec_reader_create(kv_get_value(ctx->value),
+                                  kv_get_value_size(ctx->value),
+                                  &ctx->reader);
+    if (ret != RKV_SUCCESS) {
+        error("%s", getRKVStoreErrStr(ret));
+    }
+    R_InitInPStream(&stream, ctx->reader, R_pstream_any_format,
+                    inObjectChar, inObjectBytes, NULL, R_NilValue);
+    return R_Unserialize(&stream);
+}
+
+static void releaseObjectCtx(void *data) {
+    rkv_object_ctx_t *ctx = (rkv_object_ctx_t *)data;
+
+    if (ctx->value != NULL) {
+        r_kv_release_value(&ctx->value);
+    }
+    rkv_codec_writer_release(ctx->writer);
+    rkv_codec_reader_release(ctx->reader);
+    ctx->writer = NULL;
+    ctx->reader = NULL;
+}
+
+static void outObjectChar(R_outpstream_t stream, int c) {
+    unsigned char byte = (unsigned char)c;
+    outObjectBytes(stream, &byte, 1);
+}
+
+static void outObjectBytes(R_outpstream_t stream, void *buf, int n) {
+    rkv_error_t ret;
+
+    ret = rkv_codec_write((rkv_codec_writer_t *)stream->data, buf, n);
+    if (ret != RKV_SUCCESS) {
+        error("%s", getRKVStoreErrStr(ret));
+    }
+}
+
+static int inObjectChar(R_inpstream_t stream) {
+    unsigned char byte;
+    inObjectBytes(stream, &byte, 1);
+    return byte;
+}
+
+static void inObjectBytes(R_inpstream_t stream, void *buf, int n) {
+    rkv_error_t ret;
+
+    ret = rkv_codec_read((rkv_codec_reader_t *)stream->data, buf, n);
+    if (ret != RKV_SUCCESS) {
+        error("%s", getRKVStoreErrStr(ret));
+    }
+}
+
+/*
+ * Put a raw vector as a large object: chunks under the minor path of the
+ * key, put concurrently by batches, and then the manifest at the key. The
+ * chunks go under a new generation, so the object being replaced stays
+ * whole until the manifest is switched, and its chunks are deleted then.
+ */
+SEXP rkv_put_lob(SEXP store, SEXP key, SEXP raw) {
+    rkv_store_t *rkvStore = NULL;
     kv_store_t *kvstore = NULL;
     kv_key_t *kvKey = NULL;
-    int ret;
+    kv_key_t *keys[RKV_LOB_BATCH_SIZE];
+    kv_value_t *values[RKV_LOB_BATCH_SIZE];
+    rkv_error_t errs[RKV_LOB_BATCH_SIZE];
+    kv_value_t *kvValue = NULL;
+    rkv_lob_manifest_t manifest, oldManifest;
+    unsigned char buf[RKV_CODEC_MANIFEST_SIZE];
+    const unsigned char *data;
+    const char *uri = NULL;
+    int hasOld, nBatch, iChunk, i;
+    rkv_error_t ret;
 
-    kvstore = getKVStore(store);
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
     kvKey = getKey(key);
+    if (TYPEOF(raw) != RAWSXP) {
+        ERROR_INVALID_ARGUMENT("raw");
+    }
+    data = RAW(raw);
+    manifest.size = (size_t)XLENGTH(raw);
+    manifest.chunkSize = RKV_LOB_CHUNK_SIZE;
+    manifest.nChunks = (int)((manifest.size + RKV_LOB_CHUNK_SIZE - 1) /
+                             RKV_LOB_CHUNK_SIZE);
 
-    ret = r_kv_delete(kvstore, kvKey);
-    if (ret == 1) {
-        Rprintf("Operation successful.\n");
-    } else if (ret == 0) {
-        Rprintf("Key is not existed.\n");
-    } else {
-        Rprintf("Operation failed.\n");
+    ret = r_kv_get_key_uri(kvKey, &uri);
+    RETURN_NULL_IF_ERR(ret);
+    hasOld = (getLobManifest(kvstore, kvKey, &oldManifest) == RKV_SUCCESS);
+    manifest.generation = hasOld ? oldManifest.generation + 1 : 0;
+
+    for (iChunk = 0; iChunk < manifest.nChunks; iChunk += nBatch) {
+        nBatch = (manifest.nChunks - iChunk < RKV_LOB_BATCH_SIZE) ?
+                 manifest.nChunks - iChunk : RKV_LOB_BATCH_SIZE;
+
+        ret = createChunkKeys(kvstore, uri, manifest.generation, iChunk,
+                              nBatch, keys);
+        if (ret != RKV_SUCCESS) {
+            break;
+        }
+        for (i = 0; i < nBatch; i++) {
+            size_t offset = (size_t)(iChunk + i) * RKV_LOB_CHUNK_SIZE;
+            size_t len = manifest.size - offset;
+
+            if (len > RKV_LOB_CHUNK_SIZE) {
+                len = RKV_LOB_CHUNK_SIZE;
+            }
+            values[i] = NULL;
+            errs[i] = r_kv_wrap_value_bytes(kvstore, &values[i],
+                                            data + offset, (int)len);
+            if (errs[i] != RKV_SUCCESS) {
+                r_kv_release_key(&keys[i]);
+            }
+        }
+
+        r_kv_put_batch(rkvStore, keys, values, errs, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+            if (ret == RKV_SUCCESS && errs[i] != RKV_SUCCESS) {
+                ret = errs[i];
+            }
+        }
+        releaseChunkKeys(keys, nBatch);
+        if (ret != RKV_SUCCESS) {
+            iChunk += nBatch;
+            break;
+        }
     }
-    return R_NilValue;
+
+    /* Readers only see the object once all of its chunks are put */
+    if (ret == RKV_SUCCESS) {
+        rkv_codec_write_manifest(&manifest, buf);
+        ret = r_kv_create_value_bytes(kvstore, &kvValue, buf, sizeof(buf));
+    }
+    if (ret == RKV_SUCCESS) {
+        ret = r_kv_put(kvstore, kvKey, kvValue, NULL);
+        r_kv_release_value(&kvValue);
+    }
+    if (ret != RKV_SUCCESS) {
+        /* The previous object is untouched, only drop the new chunks */
+        deleteLobChunks(rkvStore, uri, manifest.generation, 0, iChunk);
+    }
+    RETURN_NULL_IF_ERR(ret);
+    if (hasOld) {
+        deleteLobChunks(rkvStore, uri, oldManifest.generation, 0,
+                        oldManifest.nChunks);
+    }
+    return makeExternalLogic(1);
 }
 
-SEXP rkv_multi_delete(SEXP store, SEXP key, SEXP start, SEXP end){
+/*
+ * Get a large object: its chunks are got concurrently by batches and
+ * copied into a raw vector allocated from the size in the manifest.
+ */
+SEXP rkv_get_lob(SEXP store, SEXP key) {
+    rkv_store_t *rkvStore = NULL;
     kv_store_t *kvstore = NULL;
     kv_key_t *kvKey = NULL;
-    const char *keyStart = NULL, *keyEnd = NULL;
-    int nDeleted = 0;
+    kv_key_t *keys[RKV_LOB_BATCH_SIZE];
+    kv_value_t *values[RKV_LOB_BATCH_SIZE];
+    rkv_error_t errs[RKV_LOB_BATCH_SIZE];
+    rkv_lob_manifest_t manifest;
+    unsigned char *data;
+    const char *uri = NULL;
+    int nBatch, iChunk, i;
+    SEXP raw;
+    rkv_error_t ret;
 
-    kvstore = getKVStore(store);
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
     kvKey = getKey(key);
 
-    if (!isNull(start)) {
-        CHECK_IF_VALID_STRING(start, "start");
-        keyStart = (const char *)CHAR(STRING_ELT(start, 0));
+    ret = getLobManifest(kvstore, kvKey, &manifest);
+    if (ret == RKV_KEY_NOT_FOUND) {
+        return R_NilValue;
+    }
+    if (ret == RKV_SUCCESS) {
+        ret = r_kv_get_key_uri(kvKey, &uri);
+    }
+    RETURN_NULL_IF_ERR(ret);
+
+    PROTECT(raw = allocVector(RAWSXP, (R_xlen_t)manifest.size));
+    data = RAW(raw);
+    for (iChunk = 0; iChunk < manifest.nChunks; iChunk += nBatch) {
+        nBatch = (manifest.nChunks - iChunk < RKV_LOB_BATCH_SIZE) ?
+                 manifest.nChunks - iChunk : RKV_LOB_BATCH_SIZE;
+
+        ret = createChunkKeys(kvstore, uri, manifest.generation, iChunk,
+                              nBatch, keys);
+        if (ret != RKV_SUCCESS) {
+            break;
+        }
+        r_kv_get_batch(rkvStore, keys, values, errs, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            size_t offset = (size_t)(iChunk + i) * manifest.chunkSize;
+            size_t len = manifest.size - offset;
+
+            if (len > (size_t)manifest.chunkSize) {
+                len = manifest.chunkSize;
+            }
+            /* A missing chunk or one of another size is a torn object */
+            if (errs[i] == RKV_SUCCESS &&
+                (size_t)kv_get_value_size(values[i]) == len) {
+                memcpy(data + offset, kv_get_value(values[i]), len);
+            } else if (ret == RKV_SUCCESS) {
+                ret = (errs[i] == RKV_SUCCESS ||
+                       errs[i] == RKV_KEY_NOT_FOUND) ?
+                      RKV_CORRUPT_VALUE : errs[i];
+            }
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+        }
+        releaseChunkKeys(keys, nBatch);
+        if (ret != RKV_SUCCESS) {
+            break;
+        }
+    }
+    UNPROTECT(1);
+    RETURN_NULL_IF_ERR(ret);
+    return raw;
+}
+
+/* Delete a large object, its manifest first so readers never see it torn */
+SEXP rkv_delete_lob(SEXP store, SEXP key) {
+    rkv_store_t *rkvStore = NULL;
+    kv_key_t *kvKey = NULL;
+    rkv_lob_manifest_t manifest;
+    const char *uri = NULL;
+    rkv_error_t ret;
+
+    rkvStore = getRKVStore(store);
+    kvKey = getKey(key);
+
+    ret = getLobManifest(rkvStore->kvstore, kvKey, &manifest);
+    if (ret == RKV_KEY_NOT_FOUND) {
+        return makeExternalLogic(0);
+    }
+    if (ret == RKV_SUCCESS) {
+        ret = r_kv_get_key_uri(kvKey, &uri);
+    }
+    RETURN_NULL_IF_ERR(ret);
+    r_kv_delete(rkvStore->kvstore, kvKey);
+    deleteLobChunks(rkvStore, uri, manifest.generation, 0, manifest.nChunks);
+    return makeExternalLogic(1);
+}
+
+static rkv_error_t getLobManifest(kv_store_t *kvstore, const kv_key_t *key,
+                                  rkv_lob_manifest_t *manifest) {
+    kv_value_t *kvValue = NULL;
+    rkv_error_t ret;
+
+    ret = r_kv_get(kvstore, key, &kvValue);
+    if (ret != RKV_SUCCESS) {
+        return ret;
+    }
+    ret = rkv_codec_read_manifest(kv_get_value(kvValue),
+                                  kv_get_value_size(kvValue), manifest);
+    r_kv_release_value(&kvValue);
+    return ret;
+}
+
+/* The chunks are numbered minor path components under their generation */
+static rkv_error_t createChunkKeys(kv_store_t *kvstore, const char *uri,
+                                   unsigned int generation, int first, int n,
+                                   kv_key_t **keys) {
+    const char *sep = (strstr(uri, "/-/") != NULL) ? "/" : "/-/";
+    size_t len = strlen(uri) + 32;
+    char *buf;
+    rkv_error_t ret = RKV_SUCCESS;
+    int i;
+
+    buf = (char *)malloc(len);
+    if (!buf) {
+        return RKV_NO_MEMORY;
+    }
+    for (i = 0; i < n; i++) {
+        keys[i] = NULL;
+        if (ret == RKV_SUCCESS) {
+            snprintf(buf, len, "%s%s%08x/%08d", uri, sep, generation,
+                     first + i);
+            ret = r_kv_create_key_from_uri(kvstore, &keys[i], buf);
+        }
+    }
+    free(buf);
+    if (ret != RKV_SUCCESS) {
+        releaseChunkKeys(keys, n);
+    }
+    return ret;
+}
+
+static void releaseChunkKeys(kv_key_t **keys, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (keys[i] != NULL) {
+            r_kv_release_key(&keys[i]);
+        }
+    }
+}
+
+/* Best effort, a chunk left behind is only wasted space */
+static void deleteLobChunks(rkv_store_t *store, const char *uri,
+                            unsigned int generation, int first, int last) {
+    kv_key_t *keys[RKV_LOB_BATCH_SIZE];
+    int results[RKV_LOB_BATCH_SIZE];
+    int nBatch, iChunk;
+
+    for (iChunk = first; iChunk < last; iChunk += nBatch) {
+        nBatch = (last - iChunk < RKV_LOB_BATCH_SIZE) ?
+                 last - iChunk : RKV_LOB_BATCH_SIZE;
+        if (createChunkKeys(store->kvstore, uri, generation, iChunk, nBatch,
+                            keys) != RKV_SUCCESS) {
+            return;
+        }
+        r_kv_delete_batch(store, keys, results, nBatch);
+        releaseChunkKeys(keys, nBatch);
+    }
+}
+
+/* Read the bytes of the value straight into a raw vector */
+SEXP rkv_get_raw(SEXP store, SEXP key) {
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    kv_value_t *kvValue = NULL;
+    rkv_error_t ret;
+    SEXP raw;
+
+    kvstore = getKVStore(store);
+    kvKey = getKey(key);
+
+    ret = r_kv_get(kvstore, kvKey, &kvValue);
+    if (ret == RKV_KEY_NOT_FOUND) {
+        return R_NilValue;
+    }
+    RETURN_NULL_IF_ERR(ret);
+    raw = makeExternalRaw(kvValue);
+    r_kv_release_value(&kvValue);
+    return raw;
+}
+
+SEXP rkv_delete(SEXP store, SEXP key) {
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    int ret;
+
+    kvstore = getKVStore(store);
+    kvKey = getKey(key);
+
+    ret = r_kv_delete(kvstore, kvKey);
+    if (ret == 1) {
+        Rprintf("Operation successful.\n");
+    } else if (ret == 0) {
+        Rprintf("Key is not existed.\n");
+    } else {
+        Rprintf("Operation failed.\n");
+    }
+    return R_NilValue;
+}
+
+SEXP rkv_multi_delete(SEXP store, SEXP key, SEXP start, SEXP end){
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    const char *keyStart = NULL, *keyEnd = NULL;
+    int nDeleted = 0;
+
+    kvstore = getKVStore(store);
+    kvKey = getKey(key);
+
+    if (!isNull(start)) {
+        CHECK_IF_VALID_STRING(start, "start");
+        keyStart = (const char *)CHAR(STRING_ELT(start, 0));
+    }
+    if (!isNull(end)) {
+        CHECK_IF_VALID_STRING(end, "end");
+        keyEnd = (const char *)CHAR(STRING_ELT(end, 0));
+    }
+    nDeleted = r_kv_multi_delete(kvstore, kvKey, keyStart, keyEnd);
+    if (nDeleted >= 0) {
+        Rprintf("%d records deleted.\n", nDeleted);
+    }
+    return makeExternalInt(nDeleted);
+}
+
+SEXP rkv_put_dataframe(SEXP store, SEXP df, SEXP schema, SEXP keyUris) {
+    rkv_store_t *rkvStore = NULL;
+    kv_store_t *kvstore = NULL;
+    avro_value_t *avroValue = NULL;
+    rkv_encode_column_t *columns = NULL;
+    avro_schema_t avroSchema = NULL;
+    rkv_batch_keys_t batchKeys;
+    kv_key_t *keys[RKV_BATCH_SIZE];
+    kv_value_t *values[RKV_BATCH_SIZE];
+    rkv_error_t errs[RKV_BATCH_SIZE];
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    int nColumns = 0, nFailed = 0, nBatch, i, badField = -1;
+    R_xlen_t nRows, iRow;
+    SEXP status = R_NilValue;
+    rkv_error_t ret;
+
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
+    if (!isNewList(df)) {
+        ERROR_INVALID_ARGUMENT("df");
+    }
+    getBatchKeys(kvstore, keyUris, "key_uris", &batchKeys);
+    nRows = batchKeys.nKeys;
+    if (LENGTH(df) > 0 && XLENGTH(VECTOR_ELT(df, 0)) != nRows) {
+        error("'key_uris' must have one key per row of 'df'.");
+    }
+
+    /* Resolve the schema and the column to field mapping only once */
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    ret = r_kv_create_avro_value(rkvStore, space, name, &avroValue);
+    if (ret == RKV_SUCCESS) {
+        avroSchema = r_kv_get_schema(rkvStore, space, name);
+        ret = createEncodeColumns(avroSchema, df, &columns, &nColumns,
+                                  &badField);
+    }
+    free(schemaBuf);
+    CLEANUP_IF_RERR(ret);
+
+    PROTECT(status = allocVector(LGLSXP, nRows));
+    for (iRow = 0; iRow < nRows; iRow += nBatch) {
+        if (checkInterrupt()) {
+            break;
+        }
+        nBatch = (nRows - iRow < RKV_BATCH_SIZE) ?
+                 (int)(nRows - iRow) : RKV_BATCH_SIZE;
+
+        /* Encode the rows on this thread, they are read from R objects */
+        nextBatchKeys(&batchKeys, iRow, nBatch, keys);
+        for (i = 0; i < nBatch; i++) {
+            values[i] = NULL;
+            ret = RKV_INVALID_ARGUEMENTS;
+            if (keys[i] != NULL) {
+                ret = encodeDataFrameRow(avroValue, columns, nColumns,
+                                         iRow + i);
+            }
+            if (ret == RKV_SUCCESS) {
+                ret = r_kv_create_value_avro(kvstore, &values[i], avroValue);
+            }
+            if (ret != RKV_SUCCESS) {
+                releaseBatchKey(&batchKeys, &keys[i]);
+            }
+        }
+
+        r_kv_put_batch(rkvStore, keys, values, errs, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            releaseBatchKey(&batchKeys, &keys[i]);
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+            LOGICAL(status)[iRow + i] = (errs[i] == RKV_SUCCESS);
+            if (errs[i] != RKV_SUCCESS) {
+                nFailed++;
+            }
+        }
+    }
+    UNPROTECT(1);
+    ret = (iRow < nRows) ? RKV_INTERRUPTED : RKV_SUCCESS;
+    CLEANUP_IF_RERR(ret);
+    if (nFailed > 0) {
+        Rprintf("%d of %ld records failed to put.\n", nFailed, (long)nRows);
+    }
+
+Cleanup:
+    if (columns != NULL) {
+        free(columns);
+    }
+    if (avroValue != NULL) {
+        r_kv_release_avro_value(avroValue);
+    }
+    if (badField >= 0) {
+        errorEncodeColumn(avroSchema, df, badField, ret);
+    }
+    ERROR_IF_INTERRUPTED(ret);
+    RETURN_NULL_IF_ERR(ret);
+    return status;
+}
+
+SEXP rkv_get_many(SEXP store, SEXP uris, SEXP schema) {
+    rkv_store_t *rkvStore = NULL;
+    kv_store_t *kvstore = NULL;
+    avro_schema_t avroSchema = NULL;
+    rkv_frame_t *frame = NULL;
+    rkv_batch_keys_t batchKeys;
+    kv_key_t *keys[RKV_BATCH_SIZE];
+    kv_value_t *values[RKV_BATCH_SIZE];
+    rkv_error_t errs[RKV_BATCH_SIZE];
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    int nBatch = 0, i;
+    R_xlen_t nKeys, iKey;
+    SEXP found = R_NilValue, df = R_NilValue;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
+    getBatchKeys(kvstore, uris, "uris", &batchKeys);
+    nKeys = batchKeys.nKeys;
+
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    avroSchema = r_kv_get_schema(rkvStore, space, name);
+    if (!avroSchema) {
+        ret = RKV_INVALID_SCHEMA;
+    }
+    free(schemaBuf);
+    RETURN_NULL_IF_ERR(ret);
+
+    ret = createFrame(avroSchema, R_NilValue, NULL, nKeys, &frame);
+    RETURN_NULL_IF_ERR(ret);
+    for (i = 0; i < frame->nColumns; i++) {
+        if (strcmp(frame->columns[i].name, "found") == 0) {
+            releaseFrame(frame);
+            error("The schema has a field named \"found\", which clashes "
+                  "with the found column of the result.");
+        }
+    }
+
+    PROTECT(found = allocVector(LGLSXP, nKeys));
+    for (iKey = 0; iKey < nKeys; iKey += nBatch) {
+        nBatch = (nKeys - iKey < RKV_BATCH_SIZE) ?
+                 (int)(nKeys - iKey) : RKV_BATCH_SIZE;
+
+        nextBatchKeys(&batchKeys, iKey, nBatch, keys);
+        r_kv_get_batch(rkvStore, keys, values, errs, nBatch);
+
+        /* Decode on this thread, the columns are R objects */
+        for (i = 0; i < nBatch; i++) {
+            rkv_error_t err = errs[i];
+
+            /* Found only if decoded, a value of another schema is NA too */
+            if (ret == RKV_SUCCESS) {
+                if (err == RKV_SUCCESS) {
+                    err = appendFrameValue(frame, keys[i], values[i]);
+                }
+                if (err != RKV_SUCCESS) {
+                    ret = appendFrameNARow(frame);
+                }
+            }
+            LOGICAL(found)[iKey + i] = (err == RKV_SUCCESS);
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+            releaseBatchKey(&batchKeys, &keys[i]);
+        }
+        CLEANUP_IF_RERR(ret);
+    }
+
+    df = frameToDataFrame(frame);
+    df = addDataFrameColumn(df, LENGTH(df), "found", found);
+
+Cleanup:
+    UNPROTECT(1);
+    releaseFrame(frame);
+    RETURN_NULL_IF_ERR(ret);
+    return df;
+}
+
+SEXP rkv_delete_many(SEXP store, SEXP uris) {
+    rkv_store_t *rkvStore = NULL;
+    rkv_batch_keys_t batchKeys;
+    kv_key_t *keys[RKV_BATCH_SIZE];
+    int results[RKV_BATCH_SIZE];
+    int nBatch = 0, i;
+    R_xlen_t nKeys, iKey;
+    SEXP deleted;
+
+    rkvStore = getRKVStore(store);
+    getBatchKeys(rkvStore->kvstore, uris, "uris", &batchKeys);
+    nKeys = batchKeys.nKeys;
+
+    PROTECT(deleted = allocVector(LGLSXP, nKeys));
+    for (iKey = 0; iKey < nKeys; iKey += nBatch) {
+        nBatch = (nKeys - iKey < RKV_BATCH_SIZE) ?
+                 (int)(nKeys - iKey) : RKV_BATCH_SIZE;
+
+        nextBatchKeys(&batchKeys, iKey, nBatch, keys);
+        r_kv_delete_batch(rkvStore, keys, results, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            if (results[i] < 0) {
+                LOGICAL(deleted)[iKey + i] = NA_LOGICAL;
+            } else {
+                LOGICAL(deleted)[iKey + i] = (results[i] > 0);
+            }
+            releaseBatchKey(&batchKeys, &keys[i]);
+        }
+    }
+    UNPROTECT(1);
+    return deleted;
+}
+
+SEXP rkv_multiget_values(SEXP store, SEXP schema, SEXP key, SEXP start,
+                         SEXP end, SEXP columns, SEXP filter) {
+    return scanValues(store, schema, key, start, end, columns, filter, 1);
+}
+
+SEXP rkv_store_values(SEXP store, SEXP schema, SEXP key, SEXP start,
+                      SEXP end, SEXP columns, SEXP filter) {
+    return scanValues(store, schema, key, start, end, columns, filter, 0);
+}
+
+/*
+ * Group the records under the key by the values of some fields and
+ * compute count, sum, mean, min and max while scanning. Each record is
+ * decoded into a one row frame and folded into a hash table of groups, so
+ * the records are never collected into R vectors.
+ */
+SEXP rkv_aggregate(SEXP store, SEXP schema, SEXP key, SEXP by,
+                   SEXP aggs, SEXP filter) {
+
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    kv_iterator_t *iterator = NULL;
+    avro_schema_t avroSchema = NULL;
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    int badIndex = -1;
+    rkv_filter_t *rkvFilter = NULL;
+    rkv_aggregate_t *aggregate = NULL;
+    rkv_frame_t *frame = NULL;
+    rkv_itr_stats_t stats = {0};
+    SEXP fields, df = R_NilValue;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    /* get kvstore */
+    kvstore = getKVStore(store);
+    if (!isNull(by) && !isString(by)) {
+        ERROR_INVALID_STRING("by");
+    }
+    if (!isString(aggs)) {
+        ERROR_INVALID_STRING("aggs");
+    }
+
+    /* Check if specified schame is valid, get avro schema object */
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    avroSchema = r_kv_get_schema(getRKVStore(store), space, name);
+    if (!avroSchema) {
+        ret = RKV_INVALID_SCHEMA;
+    }
+    free(schemaBuf);
+    RETURN_NULL_IF_ERR(ret);
+
+    /* get kvKey, the whole store is scanned without one */
+    if (!isNull(key)) {
+        kvKey = getKey(key);
+    }
+
+    /* parsed before anything is allocated, they raise the syntax errors */
+    rkvFilter = getFilter(filter);
+    ret = rkv_aggregate_create(by, aggs, &aggregate, &badIndex);
+    if (ret != RKV_SUCCESS) {
+        rkv_filter_release(rkvFilter);
+        if (badIndex >= 0) {
+            error("Invalid aggregate: %s",
+                  CHAR(STRING_ELT(aggs, badIndex)));
+        }
+        error("%s", getRKVStoreErrStr(ret));
+    }
+
+    /* a one row frame holds the fields of the current record */
+    PROTECT(fields = rkv_aggregate_fields(aggregate));
+    ret = createFrame(avroSchema, fields, rkvFilter, 1, &frame);
+    CLEANUP_IF_RERR(ret);
+    ret = rkv_aggregate_bind(aggregate, frame);
+    CLEANUP_IF_RERR(ret);
+
+    /* create iterator */
+    ret = rkv_get_iterator(kvstore, kvKey, &iterator, NULL, NULL, NULL,
+                           0, 0);
+    CLEANUP_IF_RERR(ret);
+
+    for (;;) {
+        const kv_key_t *rKey = NULL;
+        const kv_value_t *kvValue = NULL;
+
+        ret = r_kv_iterator_next_stats(iterator, &rKey, &kvValue, &stats);
+        if (ret == RKV_NO_MORE_DATA) {
+            ret = RKV_SUCCESS;
+            break;
+        }
+        CLEANUP_IF_RERR(ret);
+
+        /* skip the values that fail to decode or are filtered out */
+        ret = appendFrameValue(frame, rKey, kvValue);
+        if (ret == RKV_NO_MEMORY) {
+            goto Cleanup;
+        }
+        if (ret == RKV_SUCCESS) {
+            ret = rkv_aggregate_add_row(aggregate, 0);
+            CLEANUP_IF_RERR(ret);
+            frame->nRows = 0;
+        }
+        ret = RKV_SUCCESS;
+    }
+
+    df = rkv_aggregate_result(aggregate);
+
+Cleanup:
+    releaseFrame(frame);
+    rkv_aggregate_release(aggregate);
+    rkv_filter_release(rkvFilter);
+    if (iterator != NULL) {
+        r_kv_release_iterator(&iterator);
+    }
+    r_kv_update_itr_tuning(&stats);
+    UNPROTECT(1);
+    RETURN_NULL_IF_ERR(ret);
+    return df;
+}
+
+/*
+ * Count the records under the key or in the whole store with a key-only
+ * iterator, the keys are read in large batches and only counted.
+ */
+SEXP rkv_count(SEXP store, SEXP key, SEXP start, SEXP end, SEXP depth,
+               SEXP multiget) {
+
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    kv_iterator_t *iterator = NULL;
+    const char *keyStart = NULL, *keyEnd = NULL;
+    const kv_key_t *rKey = NULL;
+    const kv_value_t *kvValue = NULL;
+    int isMultiGet, size;
+    double count = 0;
+    rkv_itr_options_t options;
+    rkv_error_t ret;
+
+    kvstore = getKVStore(store);
+    CHECK_IF_LOGICAL(multiget, "multiget");
+    isMultiGet = LOGICAL(multiget)[0];
+    if (isMultiGet || !isNull(key)) {
+        kvKey = getKey(key);
+    }
+    if (!isNull(start)) {
+        CHECK_IF_VALID_STRING(start, "start");
+        keyStart = (const char *)CHAR(STRING_ELT(start, 0));
+    }
+    if (!isNull(end)) {
+        CHECK_IF_VALID_STRING(end, "end");
+        keyEnd = (const char *)CHAR(STRING_ELT(end, 0));
+    }
+
+    r_kv_init_itr_options(&options);
+    options.batchSize = RKV_COUNT_BATCH_SIZE;
+    options.depth = getDepth(depth);
+
+    ret = rkv_get_iterator(kvstore, kvKey, &iterator, keyStart, keyEnd,
+                           &options, 1, isMultiGet);
+    RETURN_NULL_IF_ERR(ret);
+
+    /* the multi-get iterators have read all the keys already */
+    if (r_kv_iterator_size(iterator, &size) == RKV_SUCCESS) {
+        count = size;
+    } else {
+        while ((ret = r_kv_iterator_next(iterator, &rKey,
+                                         &kvValue)) == RKV_SUCCESS) {
+            count++;
+        }
+        if (ret == RKV_NO_MORE_DATA) {
+            ret = RKV_SUCCESS;
+        }
+    }
+    r_kv_release_iterator(&iterator);
+    RETURN_NULL_IF_ERR(ret);
+
+    return makeExternalReal(count);
+}
+
+/*
+ * Randomly sample the records under the major key. A keys only multi-get
+ * picks the sample, then only the values of the sampled keys are read and
+ * decoded. The sample size is a percentage of the number of records, at
+ * least one and at most limit.
+ */
+SEXP rkv_sample_values(SEXP store, SEXP schema, SEXP key,
+                       SEXP percentage, SEXP limit) {
+
+    rkv_store_t *rkvStore = NULL;
+    kv_store_t *kvstore = NULL;
+    kv_key_t *kvKey = NULL;
+    kv_iterator_t *iterator = NULL;
+    avro_schema_t avroSchema = NULL;
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    double pct;
+    int nLimit, nSample = 0, nKept = 0, i;
+    rkv_sample_key_t *sample = NULL;
+    rkv_frame_t *frame = NULL;
+    SEXP df = R_NilValue;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    /* get kvstore */
+    rkvStore = getRKVStore(store);
+    kvstore = rkvStore->kvstore;
+    pct = asReal(percentage);
+    if (ISNAN(pct) || pct < 0 || pct > 100) {
+        ERROR_INVALID_ARGUMENT("percentage");
+    }
+    nLimit = asInteger(limit);
+    if (nLimit == NA_INTEGER || nLimit < 0) {
+        ERROR_INVALID_ARGUMENT("limit");
+    }
+
+    /* Check if specified schame is valid, get avro schema object */
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    avroSchema = r_kv_get_schema(rkvStore, space, name);
+    if (!avroSchema) {
+        ret = RKV_INVALID_SCHEMA;
+    }
+    free(schemaBuf);
+    RETURN_NULL_IF_ERR(ret);
+
+    kvKey = getKey(key);
+
+    ret = rkv_get_iterator(kvstore, kvKey, &iterator, NULL, NULL, NULL,
+                           1, 1);
+    RETURN_NULL_IF_ERR(ret);
+
+    GetRNGstate();
+    ret = sampleKeys(kvstore, iterator, pct, nLimit, &sample, &nSample,
+                     &nKept);
+    PutRNGstate();
+    r_kv_release_iterator(&iterator);
+    CLEANUP_IF_RERR(ret);
+
+    ret = createFrame(avroSchema, R_NilValue, NULL, nSample, &frame);
+    CLEANUP_IF_RERR(ret);
+    ret = fetchSample(rkvStore, sample, nSample, frame);
+    CLEANUP_IF_RERR(ret);
+
+    df = frameToDataFrame(frame);
+
+Cleanup:
+    releaseFrame(frame);
+    for (i = 0; i < nKept; i++) {
+        if (sample[i].key != NULL) {
+            r_kv_release_key(&sample[i].key);
+        }
+    }
+    free(sample);
+    RETURN_NULL_IF_ERR(ret);
+    return df;
+}
+
+static int getSampleSize(int nRecs, double percentage, int limit) {
+    int nSample = (int)(nRecs * (percentage / 100));
+
+    if (nSample == 0 && nRecs > 0) {
+        nSample = 1;
+    }
+    return (nSample > limit) ? limit : nSample;
+}
+
+/*
+ * Reservoir sampling of the keys: the sample size depends on the number
+ * of records, which is only known at the end, so up to limit keys are
+ * kept while counting and a random subset of the sample size is taken
+ * from them. The first nSample keys of the returned array are the
+ * sample, in key order, and the nKept keys are owned by the caller.
+ */
+static rkv_error_t sampleKeys(kv_store_t *kvstore, kv_iterator_t *iterator,
+                              double percentage, int limit,
+                              rkv_sample_key_t **ret_sample,
+                              int *ret_nSample, int *ret_nKept) {
+    const kv_key_t *rKey = NULL;
+    const kv_value_t *kvValue = NULL;
+    const char *uri = NULL;
+    rkv_sample_key_t *reservoir = NULL, *slot, tmp;
+    int nRecs = 0, nKept = 0, capacity = 0, nSample = 0, i, j;
+    rkv_error_t ret;
+
+    for (;;) {
+        ret = r_kv_iterator_next(iterator, &rKey, &kvValue);
+        if (ret == RKV_NO_MORE_DATA) {
+            ret = RKV_SUCCESS;
+            break;
+        }
+        CLEANUP_IF_RERR(ret);
+        nRecs++;
+
+        if (nKept < limit) {
+            if (nKept == capacity) {
+                capacity = (capacity == 0) ? 64 : capacity * 2;
+                if (capacity > limit) {
+                    capacity = limit;
+                }
+                slot = realloc(reservoir,
+                               sizeof(rkv_sample_key_t) * capacity);
+                if (slot == NULL) {
+                    ret = RKV_NO_MEMORY;
+                    goto Cleanup;
+                }
+                reservoir = slot;
+            }
+            slot = &reservoir[nKept++];
+        } else {
+            j = (int)(unif_rand() * nRecs);
+            if (j >= limit) {
+                continue;
+            }
+            slot = &reservoir[j];
+            r_kv_release_key(&slot->key);
+        }
+        slot->index = nRecs - 1;
+        slot->key = NULL;
+        ret = r_kv_get_key_uri(rKey, &uri);
+        if (ret == RKV_SUCCESS) {
+            ret = r_kv_create_key_from_uri(kvstore, &slot->key, uri);
+        }
+        CLEANUP_IF_RERR(ret);
     }
-    if (!isNull(end)) {
-        CHECK_IF_VALID_STRING(end, "end");
-        keyEnd = (const char *)CHAR(STRING_ELT(end, 0));
+
+    /* a partial shuffle picks the sample out of the reservoir */
+    nSample = getSampleSize(nRecs, percentage, limit);
+    for (i = 0; i < nSample; i++) {
+        j = i + (int)(unif_rand() * (nKept - i));
+        tmp = reservoir[i];
+        reservoir[i] = reservoir[j];
+        reservoir[j] = tmp;
     }
-    nDeleted = r_kv_multi_delete(kvstore, kvKey, keyStart, keyEnd);
-    if (nDeleted >= 0) {
-        Rprintf("%d records deleted.\n", nDeleted);
+    if (nSample > 1) {
+        qsort(reservoir, nSample, sizeof(rkv_sample_key_t),
+              compareSampleKeys);
     }
-    return makeExternalInt(nDeleted);
+
+Cleanup:
+    /* on errors too, the kept keys are released by the caller */
+    *ret_sample = reservoir;
+    *ret_nSample = nSample;
+    *ret_nKept = nKept;
+    return ret;
 }
 
-rkv_error_t getAvroSchemaFields(const avro_schema_t schema,
-                                rkv_avro_field ** ret_avro_fields,
-                                int * ret_field_size) {
+static int compareSampleKeys(const void *a, const void *b) {
+    int ia = ((const rkv_sample_key_t *)a)->index;
+    int ib = ((const rkv_sample_key_t *)b)->index;
 
-    int i, col_size = avro_schema_record_size(schema);
-    rkv_avro_field * fields = NULL, *pFields;
+    return (ia > ib) - (ia < ib);
+}
 
-    rkv_malloc(sizeof(rkv_avro_field) * col_size, (void**)&fields);
-    if (fields == NULL) {
-        return RKV_NO_MEMORY;
-    }
-    pFields = fields;
-    for (i = 0; i < col_size; i++) {
-        const char *fname = avro_schema_record_field_name(schema, i);
-        pFields->name = strdup(fname);
-        pFields->type =
-            avro_typeof(avro_schema_record_field_get(schema, fname));
-        pFields++;
-	}
-    if (ret_avro_fields) {
-        *ret_avro_fields = fields;
-    }
-    if (ret_field_size) {
-        *ret_field_size = col_size;
+/*
+ * Read the values of the sampled keys in batches and decode them, a key
+ * deleted since it was sampled is skipped.
+ */
+static rkv_error_t fetchSample(rkv_store_t *rkvStore,
+                               const rkv_sample_key_t *sample, int nSample,
+                               rkv_frame_t *frame) {
+    kv_key_t *keys[RKV_BATCH_SIZE];
+    kv_value_t *values[RKV_BATCH_SIZE];
+    rkv_error_t errs[RKV_BATCH_SIZE];
+    rkv_error_t ret = RKV_SUCCESS;
+    int iKey, nBatch, i;
+
+    for (iKey = 0; iKey < nSample && ret == RKV_SUCCESS; iKey += nBatch) {
+        nBatch = (nSample - iKey < RKV_BATCH_SIZE) ?
+                 nSample - iKey : RKV_BATCH_SIZE;
+        for (i = 0; i < nBatch; i++) {
+            keys[i] = sample[iKey + i].key;
+        }
+        r_kv_get_batch(rkvStore, keys, values, errs, nBatch);
+
+        for (i = 0; i < nBatch; i++) {
+            if (ret == RKV_SUCCESS) {
+                if (errs[i] == RKV_SUCCESS) {
+                    ret = appendFrameValue(frame, keys[i], values[i]);
+                } else if (errs[i] != RKV_KEY_NOT_FOUND) {
+                    ret = errs[i];
+                }
+            }
+            if (values[i] != NULL) {
+                r_kv_release_value(&values[i]);
+            }
+        }
     }
-    return RKV_SUCCESS;
+    return ret;
 }
 
-SEXP rkv_multiget_values(SEXP store, SEXP schema,
-                         SEXP key, SEXP start, SEXP end) {
+/*
+ * Decode the records under the key into a data frame. The number of
+ * records is only known for multi-get iterators, for store iterators the
+ * frame starts with room for a few rows and the row capacity of the
+ * columns doubles as the records are read.
+ */
+static SEXP scanValues(SEXP store, SEXP schema, SEXP key,
+                       SEXP start, SEXP end, SEXP columns, SEXP filter,
+                       int isMultiGet) {
 
     kv_store_t *kvstore = NULL;
     kv_key_t *kvKey = NULL;
     kv_iterator_t *iterator = NULL;
     avro_schema_t avroSchema = NULL;
     const char *keyStart = NULL, *keyEnd = NULL;
-    char *space = NULL, *name = NULL;
-    int nRecs = 0, nCols = 0, pc = 0, i = 0, nRvar = 0, iRec;
-    rkv_avro_field *avroFields = NULL;
-    avro_value_t *avroValue = NULL;
-    SEXP tmp, varlabels, row_names, df = R_NilValue;
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    int nRecs = 0;
+    rkv_filter_t *rkvFilter = NULL;
+    rkv_frame_t *frame = NULL;
+    rkv_itr_stats_t stats = {0};
+    SEXP df = R_NilValue;
     rkv_error_t ret = RKV_SUCCESS;
 
     /* get kvstore */
     kvstore = getKVStore(store);
+    if (!isNull(columns) && !isString(columns)) {
+        ERROR_INVALID_STRING("columns");
+    }
 
     /* Check if specified schame is valid, get avro schema object */
-    CHECK_IF_VALID_STRING(schema, "schema");
-    space = strdup((char*)CHAR(STRING_ELT(schema, 0)));
-    name = memchr(space, '.', strlen(space));
-    if (name != NULL) {
-        *name = '\0';
-        name++;
-    } else {
-        name = space;
-        space = NULL;
-    }
-    avroSchema = r_kv_get_schema(kvstore, space, name);
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    avroSchema = r_kv_get_schema(getRKVStore(store), space, name);
     if (!avroSchema) {
         ret = RKV_INVALID_SCHEMA;
     }
-    free(space);
+    free(schemaBuf);
     RETURN_NULL_IF_ERR(ret);
 
-    /* get kvKey */
-    kvKey = getKey(key);
+    /* get kvKey, the whole store is scanned without one */
+    if (isMultiGet || !isNull(key)) {
+        kvKey = getKey(key);
+    }
 
     if (!isNull(start)) {
         CHECK_IF_VALID_STRING(start, "start");
@@ -479,183 +1890,95 @@ SEXP rkv_multiget_values(SEXP store, SEXP schema,
         keyEnd = (const char *)CHAR(STRING_ELT(end, 0));
     }
 
+    /* parsed before anything is allocated, it raises the syntax errors */
+    rkvFilter = getFilter(filter);
+
     /* create iterator */
     ret = rkv_get_iterator(kvstore, kvKey, &iterator, keyStart,
-                           keyEnd, 0, 1);
-    RETURN_NULL_IF_ERR(ret);
-
-    /* get number of records */
-    ret = r_kv_iterator_size(iterator, &nRecs);
-    CLEANUP_IF_RERR(ret);
-
-    /* get avro fields */
-    ret = getAvroSchemaFields(avroSchema, &avroFields, &nCols);
+                           keyEnd, NULL, 0, isMultiGet);
     CLEANUP_IF_RERR(ret);
 
-    /* initialize dataframe */
-    PROTECT(df = allocVector(VECSXP, nCols)); pc++;
-    PROTECT(varlabels = allocVector(STRSXP, nCols)); pc++;
-    for (i = 0, nRvar = 0; i < nCols; i++) {
-        switch(avroFields[i].type) {
-	    case AVRO_INT32:
-            SET_VECTOR_ELT(df, nRvar, allocVector(INTSXP, nRecs));
-            break;
-        case AVRO_INT64:
-            SET_VECTOR_ELT(df, nRvar, allocVector(REALSXP, nRecs));
-            break;
-        case AVRO_DOUBLE:
-            SET_VECTOR_ELT(df, nRvar, allocVector(REALSXP, nRecs));
-            break;
-        case AVRO_STRING:
-            SET_VECTOR_ELT(df, nRvar, allocVector(STRSXP, nRecs));
-            break;
-        case AVRO_BOOLEAN:
-            SET_VECTOR_ELT(df, nRvar, allocVector(LGLSXP, nRecs));
-            break;
-        default:
-            continue;
-        }
-        SET_STRING_ELT(varlabels, nRvar, mkChar(avroFields[i].name));
-	    nRvar++;
+    /* get number of records, an upper bound of the rows with a filter */
+    if (isMultiGet && rkvFilter == NULL) {
+        ret = r_kv_iterator_size(iterator, &nRecs);
+        CLEANUP_IF_RERR(ret);
     }
 
+    /* initialize the column builders */
+    ret = createFrame(avroSchema, columns, rkvFilter, nRecs, &frame);
+    CLEANUP_IF_RERR(ret);
+
     /* iterate the record and save it to datafram */
-    for(i = 0, iRec = 0; i < nRecs; i++) {
+    for (;;) {
         const kv_key_t *rKey = NULL;
         const kv_value_t *kvValue = NULL;
-        int iCol;
 
         /* move iterator next */
-        ret = r_kv_iterator_next(iterator, &rKey, &kvValue);
+        ret = r_kv_iterator_next_stats(iterator, &rKey, &kvValue,
+                                       isMultiGet ? NULL : &stats);
         if (ret == RKV_NO_MORE_DATA) {
             ret = RKV_SUCCESS;
             break;
         }
         CLEANUP_IF_RERR(ret);
 
-        /* read the value of each field of the avro value. */
-        ret = r_kv_get_avrovalue(kvValue, &avroValue, avroSchema);
-        if (ret != RKV_SUCCESS) {
+        /* decode the fields of the record */
+        ret = appendFrameValue(frame, rKey, kvValue);
+        if (ret == RKV_FILTERED_OUT) {
             ret = RKV_SUCCESS;
             continue;
         }
-
-        for (iCol = 0; iCol < nCols; iCol++) {
-            const char *fname = (const char *)avroFields[iCol].name;
-            switch(avroFields[iCol].type) {
-            case AVRO_INT32: {
-                int iValue = 0;
-                ret = r_kv_avro_value_get_int(avroValue, fname, &iValue);
-                CLEANUP_IF_RERR(ret);
-                INTEGER(VECTOR_ELT(df, iCol))[iRec] = iValue;
-                break;
-            }
-            case AVRO_INT64: {
-                int64_t i64Value = 0;
-                ret = r_kv_avro_value_get_long(avroValue, fname, &i64Value);
-                CLEANUP_IF_RERR(ret);
-                if (i64Value <= 2147483647 && i64Value >= -2147483648) {
-                    INTEGER(VECTOR_ELT(df, iCol))[iRec] = (int)i64Value;
-                } else {
-                    REAL(VECTOR_ELT(df, iCol))[iRec] = (double)i64Value;
-                }
-                break;
-            }
-            case AVRO_DOUBLE:{
-                double dValue = 0.0;
-                ret = r_kv_avro_value_get_double(avroValue, fname, &dValue);
-                CLEANUP_IF_RERR(ret);
-                REAL(VECTOR_ELT(df, iCol))[iRec] = dValue;
-                break;
-            }
-            case AVRO_STRING: {
-                const char *strValue = NULL;
-                int sLen = 0;
-                ret = r_kv_avro_value_get_string(avroValue, fname, &strValue, &sLen);
-                CLEANUP_IF_RERR(ret);
-                SET_STRING_ELT(VECTOR_ELT(df, iCol), iRec, mkChar(strValue));
-                break;
-            }
-            case AVRO_BOOLEAN: {
-                int iValue = 0;
-                ret = r_kv_avro_value_get_boolean(avroValue, fname, &iValue);
-                CLEANUP_IF_RERR(ret);
-                LOGICAL(VECTOR_ELT(df, iCol))[iRec] = iValue;
-                break;
-            }
-            default:
-                continue;
-            }
-        }
-        iRec++;
-        r_kv_release_avro_value(avroValue);
-        avroValue = NULL;
+        CLEANUP_IF_RERR(ret);
     }
 
-    PROTECT(tmp = mkString("data.frame")); pc++;
-    setAttrib(df, R_ClassSymbol, tmp);
-    setAttrib(df, R_NamesSymbol, varlabels);
-    PROTECT(row_names = allocVector(STRSXP, iRec)); pc++;
-    for (i = 0; i < iRec; i++) {
-        char labelbuff[10] = {0};
-	    sprintf(labelbuff, "%d", i+1);
-	    SET_STRING_ELT(row_names, i, mkChar(labelbuff));
-    }
-    setAttrib(df, R_RowNamesSymbol, row_names);
+    df = frameToDataFrame(frame);
 
-    /* Shrink down rows size. */
-    if (iRec < nRecs) {
-        for (i = 0; i < nCols; i++) {
-            SETLENGTH(VECTOR_ELT(df, i), iRec);
-        }
-    }
 Cleanup:
-    UNPROTECT(pc);
-    if (avroFields != NULL) {
-        release_avro_fields(avroFields, nCols);
-    }
-    if (avroValue != NULL) {
-        r_kv_release_avro_value(avroValue);
-    }
+    releaseFrame(frame);
+    rkv_filter_release(rkvFilter);
     if (iterator != NULL) {
         r_kv_release_iterator(&iterator);
     }
-    if (ret != RKV_SUCCESS) {
-        return R_NilValue;
+    if (!isMultiGet) {
+        r_kv_update_itr_tuning(&stats);
     }
+    RETURN_NULL_IF_ERR(ret);
     return df;
 }
 
-static void release_avro_fields (rkv_avro_field *fields, int nFields) {
-    int i;
-    for (i = 0; i < nFields; i++) {
-        if (fields[i].name) {
-            free(fields[i].name);
-        }
-    }
-    free(fields);
-}
-
 SEXP rkv_multiget_iterator(SEXP store, SEXP key, SEXP start,
-                           SEXP end, SEXP keyonly){
+                           SEXP end, SEXP keyonly, SEXP prefetch,
+                           SEXP depth, SEXP startInclusive,
+                           SEXP endInclusive){
 
-    return createIteartorInternal(store, key, start, end, keyonly, 1);
+    return createIteartorInternal(store, key, start, end, keyonly,
+                                  prefetch, R_NilValue, depth,
+                                  startInclusive, endInclusive, 1);
 }
 
 SEXP rkv_store_iterator(SEXP store, SEXP key, SEXP start,
-                        SEXP end, SEXP keyonly){
-    return createIteartorInternal(store, key, start, end, keyonly, 0);
+                        SEXP end, SEXP keyonly, SEXP prefetch,
+                        SEXP batchSize, SEXP depth, SEXP startInclusive,
+                        SEXP endInclusive){
+    return createIteartorInternal(store, key, start, end, keyonly,
+                                  prefetch, batchSize, depth,
+                                  startInclusive, endInclusive, 0);
 }
 
 static SEXP createIteartorInternal(SEXP store, SEXP key,
                                    SEXP start, SEXP end,
-                                   SEXP keyonly, int isMultiGet) {
+                                   SEXP keyonly, SEXP prefetch,
+                                   SEXP batchSize, SEXP depth,
+                                   SEXP startInclusive, SEXP endInclusive,
+                                   int isMultiGet) {
     rkv_iterator_t *rkvIterator = NULL;
     kv_store_t *kvstore = NULL;
     kv_key_t *kvKey = NULL;
     kv_iterator_t *iterator = NULL;
     const char *keyStart = NULL, *keyEnd = NULL;
-    int isKeyOnly = 0;
+    int isKeyOnly = 0, nPrefetch;
+    rkv_itr_options_t options;
+    SEXP iteratorObj;
     rkv_error_t ret;
 
     kvstore = getKVStore(store);
@@ -670,6 +1993,24 @@ static SEXP createIteartorInternal(SEXP store, SEXP key,
     CHECK_IF_LOGICAL(keyonly, "keyonly");
     isKeyOnly = LOGICAL(keyonly)[0];
 
+    nPrefetch = asInteger(prefetch);
+    if (nPrefetch == NA_INTEGER || nPrefetch < 0) {
+        ERROR_INVALID_ARGUMENT("prefetch");
+    }
+
+    r_kv_init_itr_options(&options);
+    if (!isNull(batchSize)) {
+        options.batchSize = asInteger(batchSize);
+        if (options.batchSize == NA_INTEGER || options.batchSize < 0) {
+            ERROR_INVALID_ARGUMENT("batch_size");
+        }
+    }
+    options.depth = getDepth(depth);
+    CHECK_IF_LOGICAL(startInclusive, "start_inclusive");
+    options.startInclusive = LOGICAL(startInclusive)[0];
+    CHECK_IF_LOGICAL(endInclusive, "end_inclusive");
+    options.endInclusive = LOGICAL(endInclusive)[0];
+
     if (!isNull(start)) {
         CHECK_IF_VALID_STRING(start, "start");
         keyStart = (const char *)CHAR(STRING_ELT(start, 0));
@@ -680,21 +2021,54 @@ static SEXP createIteartorInternal(SEXP store, SEXP key,
     }
 
     ret = rkv_get_iterator(kvstore, kvKey, &iterator, keyStart,
-                           keyEnd, isKeyOnly, isMultiGet);
+                           keyEnd, &options, isKeyOnly, isMultiGet);
     RETURN_NULL_IF_ERR(ret);
 
-    rkvIterator = rkv_itr_init(iterator);
-    return makeExternalPtr(rkvIterator, sym_kv_iterator, CLASS_KV_ITERATOR,
-                           rkvIteratorFinalizer);
+    rkvIterator = rkv_itr_init(iterator, getRKVStore(store), isKeyOnly,
+                               isMultiGet);
+    if (rkvIterator == NULL) {
+        r_kv_release_iterator(&iterator);
+        RETURN_NULL_IF_ERR(RKV_NO_MEMORY);
+    }
+    if (nPrefetch > 0) {
+        /* The producer owns the kv iterator from now on, take the size
+           while it is still safe to call into it. */
+        rkvIterator->sizeErr = r_kv_iterator_size(iterator,
+                                                  &rkvIterator->size);
+        ret = rkv_prefetch_start(kvstore, iterator, nPrefetch,
+                                 isMultiGet ? NULL : &rkvIterator->stats,
+                                 &rkvIterator->prefetch);
+        if (ret != RKV_SUCCESS) {
+            release_rkvItearator(rkvIterator);
+            RETURN_NULL_IF_ERR(ret);
+        }
+        rkvIterator->nextPrefetching = prefetchingIterators;
+        prefetchingIterators = rkvIterator;
+    }
+    /*
+     * The store handle is kept in the protected slot: the store can't be
+     * collected while the iterator is reachable, and the iterator can
+     * tell when the store has been closed with rkv_close_store().
+     */
+    iteratorObj = makeExternalPtr(rkvIterator, sym_kv_iterator,
+                                  cls_kv_iterator, rkvIteratorFinalizer);
+    R_SetExternalPtrProtected(iteratorObj, store);
+    return iteratorObj;
 }
 
 SEXP rkv_iterator_size(SEXP iterator) {
+    rkv_iterator_t *rkvIterator = NULL;
     kv_iterator_t *kvIterator = NULL;
     int size = 0;
     rkv_error_t ret;
 
-    kvIterator = get_kvIterator_from_Obj(iterator, NULL);
-    ret = r_kv_iterator_size(kvIterator, &size);
+    kvIterator = get_kvIterator_from_Obj(iterator, &rkvIterator);
+    if (rkvIterator->prefetch != NULL) {
+        ret = rkvIterator->sizeErr;
+        size = rkvIterator->size;
+    } else {
+        ret = r_kv_iterator_size(kvIterator, &size);
+    }
     RETURN_NULL_IF_ERR(ret);
 
     return makeExternalInt(size);
@@ -702,41 +2076,154 @@ SEXP rkv_iterator_size(SEXP iterator) {
 
 SEXP rkv_iterator_next(SEXP iterator) {
     rkv_iterator_t *rkvIterator = NULL;
-    kv_iterator_t *kvIterator = NULL;
     const kv_key_t *kvKey = NULL;
     const kv_value_t *kvValue = NULL;
     rkv_error_t ret;
 
-    kvIterator = get_kvIterator_from_Obj(iterator, &rkvIterator);
-    ret = r_kv_iterator_next(kvIterator, &kvKey, &kvValue);
+    get_kvIterator_from_Obj(iterator, &rkvIterator);
+    ret = rkv_itr_next(rkvIterator, &kvKey, &kvValue);
+    ERROR_IF_INTERRUPTED(ret);
     if (ret != RKV_SUCCESS) {
         return makeExternalLogic(0);
     }
-
-    rkv_itr_set_key_value(rkvIterator, kvKey, kvValue);
     return makeExternalLogic(1);
 }
 
+/*
+ * Advance the iterator up to n times and return the records as a data
+ * frame chunk: the key uris followed by either the raw values or the
+ * columns of the decoded avro records. NULL once the iterator is
+ * exhausted.
+ */
+SEXP rkv_iterator_next_batch(SEXP iterator, SEXP n, SEXP schema,
+                             SEXP columns, SEXP filter) {
+    rkv_iterator_t *rkvIterator = NULL;
+    avro_schema_t avroSchema = NULL;
+    rkv_filter_t *rkvFilter = NULL;
+    rkv_frame_t *frame = NULL;
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
+    int nMax, nRecs = 0, pc = 0;
+    SEXP keys, values = R_NilValue, df = R_NilValue;
+    rkv_error_t ret = RKV_SUCCESS;
+
+    get_kvIterator_from_Obj(iterator, &rkvIterator);
+    nMax = asInteger(n);
+    if (nMax == NA_INTEGER || nMax <= 0) {
+        ERROR_INVALID_ARGUMENT("n");
+    }
+
+    if (!isNull(schema)) {
+        if (rkvIterator->isKeyOnly) {
+            error("The iterator only returns keys, 'schema' must be NULL.");
+        }
+        if (!isNull(columns) && !isString(columns)) {
+            ERROR_INVALID_STRING("columns");
+        }
+        schemaBuf = splitSchemaName(schema, &space, &name);
+        avroSchema = r_kv_get_schema(getIteratorStore(iterator), space,
+                                     name);
+        if (!avroSchema) {
+            ret = RKV_INVALID_SCHEMA;
+        }
+        free(schemaBuf);
+        RETURN_NULL_IF_ERR(ret);
+        rkvFilter = getFilter(filter);
+        ret = createFrame(avroSchema, columns, rkvFilter, nMax, &frame);
+        if (ret != RKV_SUCCESS) {
+            rkv_filter_release(rkvFilter);
+        }
+        RETURN_NULL_IF_ERR(ret);
+    } else if (!isNull(filter)) {
+        error("'filter' is only used with 'schema'.");
+    } else if (!rkvIterator->isKeyOnly) {
+        PROTECT(values = allocVector(VECSXP, nMax)); pc++;
+    }
+    PROTECT(keys = allocVector(STRSXP, nMax)); pc++;
+
+    /* Records rejected by the filter do not count in the batch */
+    while (nRecs < nMax) {
+        const kv_key_t *kvKey = NULL;
+        const kv_value_t *kvValue = NULL;
+        const char *uri = NULL;
+
+        ret = rkv_itr_next(rkvIterator, &kvKey, &kvValue);
+        if (ret == RKV_NO_MORE_DATA) {
+            ret = RKV_SUCCESS;
+            break;
+        }
+        CLEANUP_IF_RERR(ret);
+
+        if (frame != NULL) {
+            ret = appendFrameValue(frame, kvKey, kvValue);
+            if (ret == RKV_FILTERED_OUT) {
+                ret = RKV_SUCCESS;
+                continue;
+            }
+            CLEANUP_IF_RERR(ret);
+        }
+        r_kv_get_key_uri(kvKey, &uri);
+        SET_STRING_ELT(keys, nRecs, mkChar(uri));
+        if (values != R_NilValue) {
+            /* Inflated like rkv_get_value() and rkv_get_raw() do */
+            SET_VECTOR_ELT(values, nRecs, makeExternalRaw(kvValue));
+        }
+        nRecs++;
+    }
+    if (nRecs == 0) {
+        goto Cleanup;
+    }
+
+    if (nRecs < nMax) {
+        keys = xlengthgets(keys, nRecs);
+        UNPROTECT(1);
+        PROTECT(keys);
+    }
+    if (frame != NULL) {
+        df = frameToDataFrame(frame);
+    } else {
+        SEXP columns, names;
+        int nCols = (values != R_NilValue) ? 1 : 0;
+
+        PROTECT(columns = allocVector(VECSXP, nCols)); pc++;
+        PROTECT(names = allocVector(STRSXP, nCols)); pc++;
+        if (nCols > 0) {
+            SET_VECTOR_ELT(columns, 0, xlengthgets(values, nRecs));
+            SET_STRING_ELT(names, 0, mkChar("value"));
+        }
+        df = makeDataFrame(columns, names, nRecs);
+    }
+    df = addDataFrameColumn(df, 0, "key", keys);
+
+Cleanup:
+    UNPROTECT(pc);
+    releaseFrame(frame);
+    rkv_filter_release(rkvFilter);
+    ERROR_IF_INTERRUPTED(ret);
+    RETURN_NULL_IF_ERR(ret);
+    return df;
+}
+
 SEXP rkv_iterator_get_key(SEXP iterator){
     rkv_iterator_t * rkvIterator = NULL;
     kv_key_t * kvKey = NULL;
 
-    rkvIterator = (rkv_iterator_t *)getIterator(iterator);
+    get_kvIterator_from_Obj(iterator, &rkvIterator);
     kvKey = rkv_itr_get_currentKey(rkvIterator);
     /*Returned key are owned by the iterator and released implicitly
       when it is released */
-    return makeExternalPtr(kvKey, sym_kv_key, CLASS_KV_KEY, NULL);
+    return makeExternalPtr(kvKey, sym_kv_key, cls_kv_key, NULL);
 }
 
 SEXP rkv_iterator_get_value(SEXP iterator){
     rkv_iterator_t * rkvIterator = NULL;
     kv_value_t * kvValue = NULL;
 
-    rkvIterator = (rkv_iterator_t *)getIterator(iterator);
+    get_kvIterator_from_Obj(iterator, &rkvIterator);
     kvValue = rkv_itr_get_currentValue(rkvIterator);
     /*Returned value are owned by the iterator and released implicitly
       when it is released */
-    return makeExternalPtr(kvValue, sym_kv_value, CLASS_KV_VALUE, NULL);
+    return makeExternalPtr(kvValue, sym_kv_value, cls_kv_value, NULL);
 }
 
 static void rkvIteratorFinalizer(SEXP ptr) {
@@ -751,15 +2238,49 @@ static void rkvIteratorFinalizer(SEXP ptr) {
 static void release_rkvItearator(rkv_iterator_t *rkvIterator) {
     if (rkvIterator == NULL)
         return;
+    stopPrefetch(rkvIterator);
+    if (!rkvIterator->isMultiGet) {
+        r_kv_update_itr_tuning(&rkvIterator->stats);
+    }
     r_kv_release_iterator(&rkvIterator->kvIterator);
     free(rkvIterator);
 }
 
+/* Stop the producer thread and release the records it read ahead */
+static void stopPrefetch(rkv_iterator_t *rkvIterator) {
+    rkv_iterator_t **link = &prefetchingIterators;
+
+    if (rkvIterator->prefetch == NULL) {
+        return;
+    }
+    rkv_prefetch_release(rkvIterator->prefetch);
+    rkv_itr_set_key_value(rkvIterator, NULL, NULL);
+    rkvIterator->prefetch = NULL;
+    while (*link != NULL && *link != rkvIterator) {
+        link = &(*link)->nextPrefetching;
+    }
+    if (*link != NULL) {
+        *link = rkvIterator->nextPrefetching;
+    }
+}
+
+static void stopStorePrefetches(const rkv_store_t *store) {
+    rkv_iterator_t *rkvIterator = prefetchingIterators, *next;
+
+    while (rkvIterator != NULL) {
+        next = rkvIterator->nextPrefetching;
+        if (rkvIterator->store == store) {
+            stopPrefetch(rkvIterator);
+        }
+        rkvIterator = next;
+    }
+}
+
 SEXP rkv_release_iterator(SEXP iterator){
-    rkv_iterator_t *rkvIterator = NULL;
-    get_kvIterator_from_Obj(iterator, &rkvIterator);
+    /* An iterator is released even if its store has been closed */
+    rkv_iterator_t *rkvIterator = (rkv_iterator_t *)getIterator(iterator);
     release_rkvItearator(rkvIterator);
-    R_ClearExternalPtr(getAttrib(iterator, sym_kv_iterator));
+    R_ClearExternalPtr(iterator);
     return R_NilValue;
 }
 
@@ -767,28 +2288,18 @@ SEXP rkv_release_iterator(SEXP iterator){
 * AVRO value related operations
 */
 SEXP rkv_create_avro_value(SEXP store, SEXP schema){
-    kv_store_t * kvstore = NULL;
+    rkv_store_t * rkvStore = NULL;
     avro_value_t * value = NULL;
-    char *space = NULL, *name = NULL;
+    const char *space = NULL, *name = NULL;
+    char *schemaBuf = NULL;
     int ret;
 
-    CHECK_IF_VALID_STRING(schema, "schema");
-    space = strdup((char*)CHAR(STRING_ELT(schema, 0)));
-    name = memchr(space, '.', strlen(space));
-    if (name != NULL) {
-        *name = '\0';
-        name++;
-    } else {
-        name = space;
-        space = NULL;
-    }
-
-    kvstore = getKVStore(store);
-    ret = r_kv_create_avro_value(kvstore, (const char *)space,
-                                 (const char *)name, &value);
-    free(space);
+    rkvStore = getRKVStore(store);
+    schemaBuf = splitSchemaName(schema, &space, &name);
+    ret = r_kv_create_avro_value(rkvStore, space, name, &value);
+    free(schemaBuf);
     RETURN_NULL_IF_ERR(ret);
-    return makeExternalPtr(value, sym_kv_avro_value, CLASS_KV_AVRO_VALUE,
+    return makeExternalPtr(value, sym_kv_avro_value, cls_kv_avro_value,
                            rkvAvroValueFinalizer);
 }
 
@@ -803,7 +2314,7 @@ SEXP rkv_release_avro_value(SEXP avroValue) {
     avro_value_t * avro_value = getAvroValue(avroValue);
 
     r_kv_release_avro_value(avro_value);
-    R_ClearExternalPtr(getAttrib(avroValue, sym_kv_avro_value));
+    R_ClearExternalPtr(avroValue);
     return R_NilValue;
 }
 
@@ -836,13 +2347,31 @@ SEXP rkv_avro_value_get_int(SEXP avroValue, SEXP name) {
 SEXP rkv_avro_value_set_long(SEXP avroValue, SEXP name, SEXP value) {
     avro_value_t * avro_value = getAvroValue(avroValue);
     const char *fname;
+    int64_t i64Value;
     rkv_error_t ret;
 
     CHECK_IF_VALID_STRING(name, "name");
     fname = (const char *)CHAR(STRING_ELT(name, 0));
     CHECK_IF_REAL(value, "value");
 
-    ret = r_kv_avro_value_set_long(avro_value, fname, asReal(value));
+    /* An integer64 is set as is, other numbers are rounded to a long */
+    if (isInteger64(value)) {
+        memcpy(&i64Value, REAL(value), sizeof(int64_t));
+        if (i64Value == RKV_NA_INTEGER64) {
+            ERROR_INVALID_ARGUMENT("value");
+        }
+    } else {
+        double dValue = asReal(value);
+
+        if (ISNAN(dValue)) {
+            ERROR_INVALID_ARGUMENT("value");
+        }
+        if (!isInInt64Range(dValue)) {
+            error("%s", getRKVStoreErrStr(RKV_VALUE_OUT_OF_RANGE));
+        }
+        i64Value = (int64_t)dValue;
+    }
+    ret = r_kv_avro_value_set_long(avro_value, fname, i64Value);
     PRINT_ERRMSG_IF_ERR(ret);
     return avroValue;
 }
@@ -857,6 +2386,9 @@ SEXP rkv_avro_value_get_long(SEXP avroValue, SEXP name) {
     fname = (const char *)CHAR(STRING_ELT(name, 0));
     ret = r_kv_avro_value_get_long(avro_value, fname, &value);
     RETURN_NULL_IF_ERR(ret);
+    if (useInteger64()) {
+        return makeExternalInteger64(value);
+    }
     if (value <= 2147483647 && value >= -2147483648) {
         return makeExternalInt((int32_t)value);
     }
@@ -1002,14 +2534,15 @@ static SEXP makeExternalString(const char *data[], int len[], int size) {
     for (i = 0; i < size; i++) {
         const char *sdata = data[i];
         int slen = (len != NULL)?len[i]:strlen(sdata);
-        if (slen > pBuf_size){
+        /* One more byte for the terminating NUL that mkChar() expects */
+        if (slen >= pBuf_size){
             if (pBuf != buf) {
                 free(pBuf);
                 pBuf = NULL;
             }
-            err = rkv_malloc(slen, (void**)&pBuf);
+            err = rkv_malloc(slen + 1, (void**)&pBuf);
             RETURN_NULL_IF_ERR(err);
-            pBuf_size = slen;
+            pBuf_size = slen + 1;
         }
         memset(pBuf, 0, pBuf_size);
         memcpy(pBuf, sdata, slen);
@@ -1022,21 +2555,87 @@ static SEXP makeExternalString(const char *data[], int len[], int size) {
     return ret;
 }
 
-static SEXP makeExternalPtr(void *obj, SEXP symbol, const char *cls_name,
+static void getBatchKeys(kv_store_t *kvstore, SEXP keys, const char *name,
+                         rkv_batch_keys_t *ret_keys) {
+    memset(ret_keys, 0, sizeof(rkv_batch_keys_t));
+    ret_keys->kvstore = kvstore;
+    if (isKVObject(keys, sym_kv_key_vector)) {
+        ret_keys->vector = (rkv_key_vector_t *)getKeyVector(keys);
+        ret_keys->nKeys = ret_keys->vector->nKeys;
+        return;
+    }
+    if (!isString(keys)) {
+        ERROR_INVALID_STRING(name);
+    }
+    ret_keys->uris = keys;
+    ret_keys->nKeys = XLENGTH(keys);
+}
+
+/* The keys of the batch at offset, NULL for the URIs that are not valid */
+static void nextBatchKeys(const rkv_batch_keys_t *batchKeys, R_xlen_t offset,
+                          int n, kv_key_t **ret_keys) {
+    int i;
+
+    if (batchKeys->vector != NULL) {
+        memcpy(ret_keys, batchKeys->vector->keys + offset,
+               sizeof(kv_key_t *) * n);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        SEXP uri = STRING_ELT(batchKeys->uris, offset + i);
+        ret_keys[i] = NULL;
+        if (uri != NA_STRING) {
+            r_kv_create_key_from_uri(batchKeys->kvstore, &ret_keys[i],
+                                     CHAR(uri));
+        }
+    }
+}
+
+static void releaseBatchKey(const rkv_batch_keys_t *batchKeys,
+                            kv_key_t **key) {
+    if (batchKeys->vector == NULL && *key != NULL) {
+        r_kv_release_key(key);
+    }
+    *key = NULL;
+}
+
+/*
+ * The handle is the external pointer itself, tagged with the symbol of its
+ * type. The class vector is the preallocated one of the type.
+ */
+static SEXP makeExternalPtr(void *obj, SEXP symbol, SEXP cls,
                             R_CFinalizer_t finalizer) {
-    SEXP ret, ptr, cls;
+    SEXP ptr;
 
-    ret = PROTECT(allocVector(INTSXP, 1));
-    INTEGER(ret)[0] = 0;
     ptr = PROTECT(R_MakeExternalPtr(obj, symbol, R_NilValue));
-    setAttrib(ret, symbol, ptr);
+    setAttrib(ptr, R_ClassSymbol, cls);
     if (finalizer) {
         R_RegisterCFinalizerEx(ptr, finalizer, TRUE);
     }
-    cls = PROTECT(allocVector(STRSXP, 1));
-    SET_STRING_ELT(cls, 0, mkChar(cls_name));
-    classgets(ret, cls);
-    UNPROTECT(3);
+    UNPROTECT(1);
+    return ptr;
+}
+
+/* Compressed values are inflated, the stored bytes are kept if that fails */
+static SEXP makeExternalRaw(const kv_value_t *value) {
+    SEXP ret;
+    const unsigned char *data = kv_get_value(value);
+    int len = kv_get_value_size(value);
+
+    if (rkv_codec_is_compressed(data, len) &&
+        rkv_codec_raw_size(data, len) <= INT_MAX) {
+        ret = PROTECT(allocVector(RAWSXP, rkv_codec_raw_size(data, len)));
+        if (rkv_codec_decompress(data, len, RAW(ret)) == RKV_SUCCESS) {
+            UNPROTECT(1);
+            return ret;
+        }
+        UNPROTECT(1);
+    }
+    ret = PROTECT(allocVector(RAWSXP, len));
+    if (len > 0) {
+        memcpy(RAW(ret), data, len);
+    }
+    UNPROTECT(1);
     return ret;
 }
 
@@ -1056,6 +2655,15 @@ static SEXP makeExternalReal(double value) {
     return ret;
 }
 
+static SEXP makeExternalInteger64(int64_t value) {
+    SEXP ret;
+    ret = PROTECT(allocVector(REALSXP, 1));
+    memcpy(REAL(ret), &value, sizeof(int64_t));
+    classgets(ret, cls_integer64);
+    UNPROTECT(1);
+    return ret;
+}
+
 static SEXP makeExternalLogic(int value) {
     SEXP ret;
     ret = PROTECT(allocVector(LGLSXP, 1));
@@ -1064,7 +2672,9 @@ static SEXP makeExternalLogic(int value) {
     return ret;
 }
 
-static rkv_iterator_t * rkv_itr_init(kv_iterator_t *iterator) {
+static rkv_iterator_t * rkv_itr_init(kv_iterator_t *iterator,
+                                      const rkv_store_t *store,
+                                      int isKeyOnly, int isMultiGet) {
     rkv_iterator_t * rkvIterator = NULL;
 
     if (iterator == NULL) {
@@ -1075,10 +2685,48 @@ static rkv_iterator_t * rkv_itr_init(kv_iterator_t *iterator) {
         return NULL;
     }
     rkvIterator->kvIterator = iterator;
+    rkvIterator->store = store;
+    rkvIterator->isKeyOnly = isKeyOnly;
+    rkvIterator->isMultiGet = isMultiGet;
 
     return rkvIterator;
 }
 
+static rkv_error_t rkv_itr_next(rkv_iterator_t *rkvIterator,
+                                const kv_key_t **ret_key,
+                                const kv_value_t **ret_value) {
+    const kv_key_t *key = NULL;
+    const kv_value_t *value = NULL;
+    rkv_error_t ret;
+
+    if (rkvIterator->prefetch != NULL) {
+        kv_key_t *ownedKey = NULL;
+        kv_value_t *ownedValue = NULL;
+
+        /* the previous record is released once the iterator moves on,
+           as it is for the records owned by a kv iterator */
+        rkv_itr_set_key_value(rkvIterator, NULL, NULL);
+        ret = rkv_prefetch_next(rkvIterator->prefetch, &ownedKey,
+                                &ownedValue);
+        key = ownedKey;
+        value = ownedValue;
+    } else {
+        ret = r_kv_iterator_next_stats(rkv_itr_get_kvIterator(rkvIterator),
+                                       &key, &value,
+                                       rkvIterator->isMultiGet ?
+                                       NULL : &rkvIterator->stats);
+    }
+    if (ret != RKV_SUCCESS) {
+        return ret;
+    }
+    rkv_itr_set_key_value(rkvIterator, key, value);
+    *ret_key = key;
+    if (ret_value) {
+        *ret_value = value;
+    }
+    return RKV_SUCCESS;
+}
+
 static kv_iterator_t *rkv_itr_get_kvIterator(rkv_iterator_t * rkvIterator) {
     if (rkvIterator == NULL) {
         return NULL;
@@ -1092,6 +2740,14 @@ static void rkv_itr_set_key_value(rkv_iterator_t * rkvIterator,
     if (rkvIterator == NULL) {
         return;
     }
+    if (rkvIterator->prefetch != NULL) {
+        if (rkvIterator->currentKey != NULL) {
+            r_kv_release_key(&rkvIterator->currentKey);
+        }
+        if (rkvIterator->currentValue != NULL) {
+            r_kv_release_value(&rkvIterator->currentValue);
+        }
+    }
     rkvIterator->currentKey = (kv_key_t *)key;
     rkvIterator->currentValue = (kv_value_t *)value;
 }
@@ -1113,8 +2769,88 @@ static kv_value_t * rkv_itr_get_currentValue(rkv_iterator_t * rkvIterator) {
 static kv_iterator_t *get_kvIterator_from_Obj(SEXP iterator,
                             rkv_iterator_t ** ret_rkvIterator) {
     rkv_iterator_t *rkvIterator = (rkv_iterator_t *)getIterator(iterator);
+
+    getIteratorStore(iterator);
     if (ret_rkvIterator) {
         *ret_rkvIterator = rkvIterator;
     }
     return rkv_itr_get_kvIterator(rkvIterator);
 }
+
+/* The store of the iterator, an error once the store has been closed */
+static rkv_store_t *getIteratorStore(SEXP iterator) {
+    SEXP store = R_ExternalPtrProtected(iterator);
+
+    if (!isKVObject(store, sym_kvstore) || !R_ExternalPtrAddr(store)) {
+        error("The store of this iterator has been closed.");
+    }
+    return (rkv_store_t *)R_ExternalPtrAddr(store);
+}
+
+/*
+ * Splits "space.name" at the last dot, avro namespaces may contain dots
+ * ("com.example.User" is the record User of the namespace com.example),
+ * and the cached schemas are matched to the namespace of the schema.
+ */
+static char *splitSchemaName(SEXP schema, const char **ret_space,
+                             const char **ret_name) {
+    char *buf = NULL, *name = NULL;
+
+    CHECK_IF_VALID_STRING(schema, "schema");
+    buf = strdup(CHAR(STRING_ELT(schema, 0)));
+    if (buf == NULL) {
+        error("Failed to allocate memory for the schema name.");
+    }
+    name = strrchr(buf, '.');
+    if (name != NULL) {
+        *name = '\0';
+        *ret_space = buf;
+        *ret_name = name + 1;
+    } else {
+        *ret_space = NULL;
+        *ret_name = buf;
+    }
+    return buf;
+}
+
+static kv_depth_t getDepth(SEXP depth) {
+    const char *name;
+
+    if (isNull(depth)) {
+        return KV_DEPTH_DEFAULT;
+    }
+    CHECK_IF_VALID_STRING(depth, "depth");
+    name = CHAR(STRING_ELT(depth, 0));
+    if (strcmp(name, "children_only") == 0) {
+        return KV_DEPTH_CHILDREN_ONLY;
+    } else if (strcmp(name, "descendants") == 0) {
+        return KV_DEPTH_DESCENDANTS_ONLY;
+    } else if (strcmp(name, "parent_and_children") == 0) {
+        return KV_DEPTH_PARENT_AND_CHILDREN;
+    } else if (strcmp(name, "parent_and_descendants") == 0) {
+        return KV_DEPTH_PARENT_AND_DESCENDANTS;
+    }
+    ERROR_INVALID_ARGUMENT("depth");
+}
+
+/* Parse the filter argument, NULL when there is none */
+static rkv_filter_t *getFilter(SEXP filter) {
+    rkv_filter_t *rkvFilter = NULL;
+    const char *expr;
+    int offset = 0;
+    rkv_error_t ret;
+
+    if (isNull(filter)) {
+        return NULL;
+    }
+    CHECK_IF_VALID_STRING(filter, "filter");
+    expr = CHAR(STRING_ELT(filter, 0));
+    ret = rkv_filter_create(expr, &rkvFilter, &offset);
+    if (ret == RKV_INVALID_FILTER) {
+        error("Invalid filter expression at character %d: %s",
+              offset + 1, expr);
+    } else if (ret != RKV_SUCCESS) {
+        error("%s", getRKVStoreErrStr(ret));
+    }
+    return rkvFilter;
+}
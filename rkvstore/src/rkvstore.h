@@ -47,8 +47,11 @@
 #include <Rinternals.h>
 
 /* KVstore open, close. */
-SEXP rkv_open_store(SEXP kvhome, SEXP host, SEXP port, SEXP kvname);
+SEXP rkv_open_store(SEXP kvhome, SEXP host, SEXP port, SEXP kvname,
+                    SEXP workers, SEXP jvmOptions);
 SEXP rkv_close_store(SEXP store);
+SEXP rkv_shutdown(void);
+SEXP rkv_refresh_schemas(SEXP store);
 
 /* Key/Value: create, release */
 SEXP rkv_create_key(SEXP store, SEXP major, SEXP minor);
@@ -57,29 +60,58 @@ SEXP rkv_get_key_uri(SEXP key);
 /*SEXP rkv_get_key_major(SEXP key);
 SEXP rkv_get_key_minor(SEXP key);*/
 SEXP rkv_release_key(SEXP key);
-SEXP rkv_create_value(SEXP store, SEXP data);
-SEXP rkv_get_value(SEXP value);
+SEXP rkv_create_keys(SEXP store, SEXP uris);
+SEXP rkv_keys_length(SEXP keys);
+SEXP rkv_release_keys(SEXP keys);
+SEXP rkv_create_value(SEXP store, SEXP data, SEXP compress);
+SEXP rkv_get_value(SEXP value, SEXP raw);
 SEXP rkv_get_avro_value(SEXP value);
+SEXP rkv_get_avro_list(SEXP value);
+SEXP rkv_get_many_avro_list(SEXP store, SEXP uris);
 SEXP rkv_release_value(SEXP value);
 
 /* put, get, delete */
-SEXP rkv_put(SEXP store, SEXP key, SEXP value);
+SEXP rkv_put(SEXP store, SEXP key, SEXP value, SEXP compress);
 SEXP rkv_get(SEXP store, SEXP key);
+SEXP rkv_get_raw(SEXP store, SEXP key);
+SEXP rkv_set_compression(SEXP store, SEXP threshold);
+SEXP rkv_put_object(SEXP store, SEXP key, SEXP object, SEXP compress);
+SEXP rkv_get_object(SEXP store, SEXP key);
+SEXP rkv_put_lob(SEXP store, SEXP key, SEXP raw);
+SEXP rkv_get_lob(SEXP store, SEXP key);
+SEXP rkv_delete_lob(SEXP store, SEXP key);
 SEXP rkv_delete(SEXP store, SEXP key);
+SEXP rkv_get_many(SEXP store, SEXP uris, SEXP schema);
+SEXP rkv_delete_many(SEXP store, SEXP uris);
 SEXP rkv_multi_delete(SEXP store, SEXP key, SEXP start, SEXP end);
+SEXP rkv_put_dataframe(SEXP store, SEXP df, SEXP schema, SEXP keyUris);
 
 /* Itearator related APIs */
 SEXP rkv_multiget_iterator(SEXP store, SEXP key, SEXP start,
-                           SEXP end, SEXP keyonly);
+                           SEXP end, SEXP keyonly, SEXP prefetch,
+                           SEXP depth, SEXP startInclusive,
+                           SEXP endInclusive);
 SEXP rkv_store_iterator(SEXP store, SEXP key, SEXP start,
-                        SEXP end, SEXP keyonly);
+                        SEXP end, SEXP keyonly, SEXP prefetch,
+                        SEXP batchSize, SEXP depth, SEXP startInclusive,
+                        SEXP endInclusive);
 SEXP rkv_iterator_size(SEXP iterator);
 SEXP rkv_iterator_next(SEXP iterator);
+SEXP rkv_iterator_next_batch(SEXP iterator, SEXP n, SEXP schema,
+                             SEXP columns, SEXP filter);
 SEXP rkv_iterator_get_key(SEXP iterator);
 SEXP rkv_iterator_get_value(SEXP iterator);
 SEXP rkv_release_iterator(SEXP iterator);
 SEXP rkv_multiget_values(SEXP store, SEXP key, SEXP schema,
-                         SEXP start, SEXP end);
+                         SEXP start, SEXP end, SEXP columns, SEXP filter);
+SEXP rkv_store_values(SEXP store, SEXP schema, SEXP key,
+                      SEXP start, SEXP end, SEXP columns, SEXP filter);
+SEXP rkv_aggregate(SEXP store, SEXP schema, SEXP key, SEXP by,
+                   SEXP aggs, SEXP filter);
+SEXP rkv_sample_values(SEXP store, SEXP schema, SEXP key,
+                       SEXP percentage, SEXP limit);
+SEXP rkv_count(SEXP store, SEXP key, SEXP start, SEXP end,
+               SEXP depth, SEXP multiget);
 
 /* Avro value related APIs */
 SEXP rkv_create_avro_value(SEXP store, SEXP schema);
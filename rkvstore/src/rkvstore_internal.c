@@ -42,19 +42,68 @@
  */
 
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jni.h>
+
 #include "utils.h"
 #include "rkvstore_internal.h"
 
+/*
+ * Batch size auto-tuning of the store iterators: a batch should carry
+ * about RKV_ITR_BATCH_BYTES of records, more on high latency links where
+ * each round trip costs more. The record size and the round trip latency
+ * are averaged over the store iterators released so far.
+ */
+#define RKV_ITR_BATCH_DEFAULT       100
+#define RKV_ITR_BATCH_MIN           100
+#define RKV_ITR_BATCH_MAX           10000
+#define RKV_ITR_BATCH_BYTES         (256 * 1024)
+#define RKV_ITR_HIGH_LATENCY        0.02
+/* An iterator next call blocking longer than this fetched a new batch */
+#define RKV_ITR_FETCH_THRESHOLD     0.0005
+
+static struct {
+    double recordSize;
+    double fetchLatency;
+} itr_tuning = {0, 0};
+
+/*
+ * The JNI impl and its JVM are shared by all the stores and outlive them,
+ * a JVM can't be created again in the same process. It is only released
+ * by r_kvstore_shutdown(), once no store uses it.
+ */
 static kv_impl_t *kv_jni_impl = NULL;
-static kv_error_t init_kvstore_jni_impl(const char *path);
-
-rkv_error_t r_kvstore_open(const char *path, const char *storename,
-                          const char *host, int port,
-                          kv_store_t ** ret_store) {
+static int kv_jni_impl_refs = 0;
+static int jvm_shut_down = 0;
+static kv_error_t init_kvstore_jni_impl(const char *path,
+                                        const char *jvmOptions);
+
+typedef struct rkv_batch {
+    kv_store_t *kvstore;
+    kv_key_t **keys;
+    kv_value_t **values;
+    rkv_error_t *errs;
+    int *results;
+} rkv_batch_t;
+
+static void putTask(void *ctx, int index);
+static void getTask(void *ctx, int index);
+static void deleteTask(void *ctx, int index);
+static rkv_schema_entry_t *getSchemaEntry(rkv_store_t *store,
+                                          const char *space,
+                                          const char *name);
+
+rkv_error_t r_kvstore_open(const char *path, const char *jvmOptions,
+                          const char *storename, const char *host, int port,
+                          int nWorkers, rkv_store_t ** ret_store) {
     kv_error_t ret;
     kv_store_t *store = NULL;
     kv_config_t *config = NULL;
     kv_impl_t *impl = NULL;
+    rkv_store_t *rkvStore = NULL;
+    rkv_error_t err;
 
 #if DEBUG
     PRINTF("kvstore_open->storename:%s, host:%s, port:%d, classpath:%s",
@@ -62,7 +111,10 @@ rkv_error_t r_kvstore_open(const char *path, const char *storename,
 #endif
 
     /* Init kvstore jni impl */
-    if ((ret = init_kvstore_jni_impl(path)) != KV_SUCCESS) {
+    if (jvm_shut_down) {
+        return RKV_JVM_SHUT_DOWN;
+    }
+    if ((ret = init_kvstore_jni_impl(path, jvmOptions)) != KV_SUCCESS) {
         return RKV_ERROR;
     }
     impl = kv_jni_impl;
@@ -90,36 +142,149 @@ rkv_error_t r_kvstore_open(const char *path, const char *storename,
         return RKV_ERROR;
     }
 
+    err = rkv_malloc(sizeof(rkv_store_t), (void**)&rkvStore);
+    if (err != RKV_SUCCESS) {
+        kv_close_store(store);
+        return err;
+    }
+    rkvStore->kvstore = store;
+    kv_jni_impl_refs++;
+
+    /*
+     * The workers issue their kv_* calls through the same kv_jni_impl as
+     * the R thread, each of them attaches itself to the JVM when it starts
+     * and detaches before it exits, see r_kv_attach_thread().
+     */
+    if (nWorkers > 0) {
+        err = rkv_pool_create(nWorkers, &rkvStore->pool);
+        if (err != RKV_SUCCESS) {
+            Rprintf("Failed to start the worker threads, "
+                    "requests will be run one by one.\n");
+        }
+    }
+
     if (ret_store != NULL) {
-        *ret_store = store;
+        *ret_store = rkvStore;
     }
 
     Rprintf("Connected.\n");
     return RKV_SUCCESS;
 }
 
-static kv_error_t init_kvstore_jni_impl(const char *path) {
+/* The JVM started by the JNI impl, a process has at most one */
+static JavaVM *getJavaVM(void) {
+    JavaVM *vm = NULL;
+    jsize nVMs = 0;
+
+    if (JNI_GetCreatedJavaVMs(&vm, 1, &nVMs) != JNI_OK || nVMs < 1) {
+        return NULL;
+    }
+    return vm;
+}
+
+/*
+ * Attaches a native thread to the JVM before it makes kv_* calls. The
+ * attachment is owned by the thread, which must call
+ * r_kv_detach_thread() before it exits, otherwise the JVM keeps a
+ * Java thread for it. Attaching an attached thread does nothing.
+ */
+rkv_error_t r_kv_attach_thread(void) {
+    JavaVM *vm = getJavaVM();
+    JNIEnv *env = NULL;
+
+    if (vm == NULL) {
+        return RKV_ERROR;
+    }
+    if ((*vm)->AttachCurrentThread(vm, (void **)&env, NULL) != JNI_OK) {
+        return RKV_ERROR;
+    }
+    return RKV_SUCCESS;
+}
+
+void r_kv_detach_thread(void) {
+    JavaVM *vm = getJavaVM();
+
+    if (vm != NULL) {
+        (*vm)->DetachCurrentThread(vm);
+    }
+}
+
+/*
+ * The JVM options are passed through JAVA_TOOL_OPTIONS, which the JVM
+ * reads when the JNI impl creates it, the variable is restored after.
+ */
+static kv_error_t init_kvstore_jni_impl(const char *path,
+                                        const char *jvmOptions) {
     kv_impl_t *impl = NULL;
+    char *oldOptions = NULL, *options = NULL;
     kv_error_t ret;
 
     if (kv_jni_impl != NULL) {
+        if (jvmOptions != NULL && *jvmOptions != '\0') {
+            Rprintf("The JVM is already running, "
+                    "the JVM options are ignored.\n");
+        }
         return KV_SUCCESS;
     }
 
+    if (jvmOptions != NULL && *jvmOptions != '\0') {
+        if (getenv("JAVA_TOOL_OPTIONS") != NULL) {
+            oldOptions = strdup(getenv("JAVA_TOOL_OPTIONS"));
+        }
+        options = malloc((oldOptions ? strlen(oldOptions) + 1 : 0) +
+                         strlen(jvmOptions) + 1);
+        if (options == NULL) {
+            free(oldOptions);
+            return KV_NO_MEMORY;
+        }
+        sprintf(options, "%s%s%s", oldOptions ? oldOptions : "",
+                oldOptions ? " " : "", jvmOptions);
+        setenv("JAVA_TOOL_OPTIONS", options, 1);
+    }
+
     ret = kv_create_jni_impl(&impl, path);
     if (ret == KV_SUCCESS) {
         kv_jni_impl = impl;
     }
+
+    if (options != NULL) {
+        if (oldOptions != NULL) {
+            setenv("JAVA_TOOL_OPTIONS", oldOptions, 1);
+        } else {
+            unsetenv("JAVA_TOOL_OPTIONS");
+        }
+        free(options);
+        free(oldOptions);
+    }
     return ret;
 }
 
-rkv_error_t r_kvstore_close(kv_store_t *store) {
-    kv_error_t ret = kv_close_store(store);
+rkv_error_t r_kvstore_close(rkv_store_t *store) {
+    kv_error_t ret;
+
+    if (!store) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+    rkv_pool_release(store->pool);
+    r_kv_invalidate_schemas(store);
+    free(store->schemas.entries);
+    ret = kv_close_store(store->kvstore);
+    free(store);
+    kv_jni_impl_refs--;
+    RETURN_MAP_TO_RERR(ret);
+}
+
+/* Release the JNI impl and its JVM, which can't be restarted after */
+rkv_error_t r_kvstore_shutdown(void) {
+    if (kv_jni_impl_refs > 0) {
+        return RKV_STORES_OPEN;
+    }
     if (kv_jni_impl != NULL) {
         kv_release_impl(&kv_jni_impl);
         kv_jni_impl = NULL;
+        jvm_shut_down = 1;
     }
-    RETURN_MAP_TO_RERR(ret);
+    return RKV_SUCCESS;
 }
 
 rkv_error_t r_kv_create_key(kv_store_t *store, kv_key_t **ret_key,
@@ -163,7 +328,7 @@ rkv_error_t r_kv_create_value_bytes(kv_store_t *store, kv_value_t **ret_value,
     kv_error_t ret;
     kv_value_t *value = NULL;
 
-    if (!store || !ret_value || (!data || !data_len)) {
+    if (!store || !ret_value || data_len < 0 || (!data && data_len > 0)) {
         return RKV_INVALID_ARGUEMENTS;
     }
 
@@ -174,6 +339,23 @@ rkv_error_t r_kv_create_value_bytes(kv_store_t *store, kv_value_t **ret_value,
     return RKV_SUCCESS;
 }
 
+/* The value uses the caller's buffer, which must outlive the value */
+rkv_error_t r_kv_wrap_value_bytes(kv_store_t *store, kv_value_t **ret_value,
+                                  const unsigned char *data, int data_len) {
+    kv_error_t ret;
+    kv_value_t *value = NULL;
+
+    if (!store || !ret_value || data_len < 0 || (!data && data_len > 0)) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    ret = kv_create_value(store, &value, data, data_len);
+    RETURN_RERR_IF_ERR(ret);
+    *ret_value = value;
+
+    return RKV_SUCCESS;
+}
+
 rkv_error_t r_kv_create_value_avro(kv_store_t *store,
                                    kv_value_t **ret_value,
                                    avro_value_t *avro_value) {
@@ -305,7 +487,6 @@ rkv_error_t r_kv_get_avrovalue(const kv_value_t *value,
                                avro_schema_t schema) {
 
     avro_value_t *avro_value = NULL;
-    kv_error_t err;
     rkv_error_t ret;
 
     if (!value || !ret_avro_value) {
@@ -315,14 +496,103 @@ rkv_error_t r_kv_get_avrovalue(const kv_value_t *value,
     ret = rkv_malloc(sizeof(avro_value_t), (void**)&avro_value);
     RETURN_IF_ERR(ret);
 
+    ret = r_kv_read_avrovalue(value, avro_value, schema);
+    if (ret != RKV_SUCCESS) {
+        free(avro_value);
+        return ret;
+    }
+    *ret_avro_value = avro_value;
+    return RKV_SUCCESS;
+}
+
+/*
+ * Decode the value into an avro_value_t owned by the caller, so that
+ * loops keep it on the stack instead of allocating it per record as
+ * r_kv_get_avrovalue() does. The driver still creates a new generic
+ * value for each record, released with avro_value_decref().
+ */
+rkv_error_t r_kv_read_avrovalue(const kv_value_t *value,
+                                avro_value_t *avro_value,
+                                avro_schema_t schema) {
+    kv_error_t err;
+
+    if (!value || !avro_value) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
     err = kv_avro_generic_to_object((kv_value_t *)value, avro_value, schema);
     if (err != KV_SUCCESS) {
         return RKV_ERROR;
     }
-    *ret_avro_value = avro_value;
     return RKV_SUCCESS;
 }
 
+void r_kv_put_batch(rkv_store_t *store, kv_key_t **keys,
+                    kv_value_t **values, rkv_error_t *ret_errs, int n) {
+    rkv_batch_t batch = {0};
+
+    batch.kvstore = store->kvstore;
+    batch.keys = keys;
+    batch.values = values;
+    batch.errs = ret_errs;
+    rkv_pool_run(store->pool, putTask, &batch, n);
+}
+
+void r_kv_get_batch(rkv_store_t *store, kv_key_t **keys,
+                    kv_value_t **ret_values, rkv_error_t *ret_errs, int n) {
+    rkv_batch_t batch = {0};
+
+    batch.kvstore = store->kvstore;
+    batch.keys = keys;
+    batch.values = ret_values;
+    batch.errs = ret_errs;
+    rkv_pool_run(store->pool, getTask, &batch, n);
+}
+
+void r_kv_delete_batch(rkv_store_t *store, kv_key_t **keys,
+                       int *ret_results, int n) {
+    rkv_batch_t batch = {0};
+
+    batch.kvstore = store->kvstore;
+    batch.keys = keys;
+    batch.results = ret_results;
+    rkv_pool_run(store->pool, deleteTask, &batch, n);
+}
+
+/* A NULL key is a slot the caller failed to prepare, it is skipped. */
+static void putTask(void *ctx, int index) {
+    rkv_batch_t *batch = (rkv_batch_t *)ctx;
+
+    if (batch->keys[index] == NULL) {
+        batch->errs[index] = RKV_INVALID_ARGUEMENTS;
+        return;
+    }
+    batch->errs[index] = r_kv_put(batch->kvstore, batch->keys[index],
+                                  batch->values[index], NULL);
+}
+
+static void getTask(void *ctx, int index) {
+    rkv_batch_t *batch = (rkv_batch_t *)ctx;
+
+    batch->values[index] = NULL;
+    if (batch->keys[index] == NULL) {
+        batch->errs[index] = RKV_INVALID_ARGUEMENTS;
+        return;
+    }
+    batch->errs[index] = r_kv_get(batch->kvstore, batch->keys[index],
+                                  &batch->values[index]);
+}
+
+static void deleteTask(void *ctx, int index) {
+    rkv_batch_t *batch = (rkv_batch_t *)ctx;
+
+    if (batch->keys[index] == NULL) {
+        batch->results[index] = RKV_INVALID_ARGUEMENTS;
+        return;
+    }
+    batch->results[index] = r_kv_delete(batch->kvstore, batch->keys[index]);
+}
+
 int r_kv_multi_delete(kv_store_t *store,
                      const kv_key_t *parent_key,
                      const char *start,
@@ -347,48 +617,65 @@ int r_kv_multi_delete(kv_store_t *store,
 }
 
 
+void r_kv_init_itr_options(rkv_itr_options_t *options) {
+    memset(options, 0, sizeof(rkv_itr_options_t));
+    options->depth = KV_DEPTH_DEFAULT;
+    options->startInclusive = 1;
+    options->endInclusive = 1;
+}
+
 rkv_error_t rkv_get_iterator(kv_store_t *store,
                             const kv_key_t *parent_key,
                             kv_iterator_t **return_iterator,
                             const char *start,
                             const char *end,
+                            const rkv_itr_options_t *options,
                             int isKeyOnly,
                             int isMultiGet) {
     kv_iterator_t *iterator = NULL;
     kv_error_t err;
     kv_key_range_t key_range, *sub_range = NULL;
+    rkv_itr_options_t defaults;
+    int batchSize;
 
     if (!store || (isMultiGet && !parent_key) || !return_iterator) {
         return RKV_INVALID_ARGUEMENTS;
     }
+    if (options == NULL) {
+        r_kv_init_itr_options(&defaults);
+        options = &defaults;
+    }
+    batchSize = (options->batchSize > 0) ?
+                options->batchSize : r_kv_get_itr_batch_size();
 
     if (start || end) {
         memset(&key_range, 0, sizeof(key_range));
-        kv_init_key_range(&key_range, start, 1, end, 1);
+        kv_init_key_range(&key_range, start, options->startInclusive,
+                          end, options->endInclusive);
         sub_range = &key_range;
     }
 
     if (isKeyOnly) {
         if (isMultiGet) {
             err = kv_multi_get_keys(store, parent_key, &iterator,
-                                    sub_range, KV_DEPTH_DEFAULT,
+                                    sub_range, options->depth,
                                     NULL, 0);
         } else {
             err = kv_store_iterator_keys(store, parent_key, &iterator,
-                                        sub_range, KV_DEPTH_DEFAULT,
+                                        sub_range, options->depth,
                                         KV_DIRECTION_UNORDERED,
-                                        100, NULL, 0);
+                                        batchSize, NULL, 0);
         }
     } else {
         if (isMultiGet) {
             err = kv_multi_get(store, parent_key, &iterator,
-                                sub_range, KV_DEPTH_DEFAULT,
+                                sub_range, options->depth,
                                 NULL, 0);
         } else {
             err = kv_store_iterator(store, parent_key, &iterator,
-                                    sub_range, KV_DEPTH_DEFAULT,
+                                    sub_range, options->depth,
                                     KV_DIRECTION_UNORDERED,
-                                    100, NULL, 0);
+                                    batchSize, NULL, 0);
         }
     }
     RETURN_RERR_IF_ERR(err);
@@ -416,13 +703,24 @@ rkv_error_t r_kv_iterator_size(kv_iterator_t *iterator, int * ret_size) {
 rkv_error_t r_kv_iterator_next(kv_iterator_t *iterator,
                                const kv_key_t **ret_key,
                                const kv_value_t **ret_value) {
+    return r_kv_iterator_next_stats(iterator, ret_key, ret_value, NULL);
+}
+
+rkv_error_t r_kv_iterator_next_stats(kv_iterator_t *iterator,
+                                     const kv_key_t **ret_key,
+                                     const kv_value_t **ret_value,
+                                     rkv_itr_stats_t *stats) {
     const kv_key_t *key = NULL;
     const kv_value_t *value = NULL;
+    struct timespec begin, end;
     kv_error_t err;
 
     if (!iterator || !ret_key ) {
         return RKV_INVALID_ARGUEMENTS;
     }
+    if (stats) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+    }
     /* A bug in C library here..
        Get a segment fault error from kv_iterator_next_key */
     err = kv_iterator_next(iterator, &key, &value);
@@ -431,6 +729,21 @@ rkv_error_t r_kv_iterator_next(kv_iterator_t *iterator,
     }
     RETURN_RERR_IF_ERR(err);
 
+    if (stats) {
+        double elapsed;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - begin.tv_sec) +
+                  (end.tv_nsec - begin.tv_nsec) / 1e9;
+        if (elapsed > RKV_ITR_FETCH_THRESHOLD) {
+            stats->nFetches++;
+            stats->fetchSeconds += elapsed;
+        }
+        stats->nRecords++;
+        if (value) {
+            stats->nBytes += kv_get_value_size(value);
+        }
+    }
+
     *ret_key = key;
     if (ret_value) {
         *ret_value = value;
@@ -438,32 +751,68 @@ rkv_error_t r_kv_iterator_next(kv_iterator_t *iterator,
     return RKV_SUCCESS;
 }
 
+void r_kv_update_itr_tuning(const rkv_itr_stats_t *stats) {
+    if (!stats || stats->nRecords < RKV_ITR_BATCH_MIN) {
+        return;
+    }
+    if (stats->nBytes > 0) {
+        double recordSize = stats->nBytes / stats->nRecords;
+        itr_tuning.recordSize = (itr_tuning.recordSize > 0) ?
+            (itr_tuning.recordSize + recordSize) / 2 : recordSize;
+    }
+    if (stats->nFetches > 0) {
+        double latency = stats->fetchSeconds / stats->nFetches;
+        itr_tuning.fetchLatency = (itr_tuning.fetchLatency > 0) ?
+            (itr_tuning.fetchLatency + latency) / 2 : latency;
+    }
+}
+
+int r_kv_get_itr_batch_size(void) {
+    double batchBytes = RKV_ITR_BATCH_BYTES;
+    double batchSize;
+
+    if (itr_tuning.recordSize <= 0) {
+        return RKV_ITR_BATCH_DEFAULT;
+    }
+    if (itr_tuning.fetchLatency > RKV_ITR_HIGH_LATENCY) {
+        batchBytes *= 4;
+    }
+    batchSize = batchBytes / itr_tuning.recordSize;
+    if (batchSize < RKV_ITR_BATCH_MIN) {
+        return RKV_ITR_BATCH_MIN;
+    }
+    if (batchSize > RKV_ITR_BATCH_MAX) {
+        return RKV_ITR_BATCH_MAX;
+    }
+    return (int)batchSize;
+}
+
 void r_kv_release_iterator(kv_iterator_t **iterator) {
     kv_release_iterator(iterator);
 }
 
-rkv_error_t r_kv_create_avro_value(kv_store_t *kvstore,
+rkv_error_t r_kv_create_avro_value(rkv_store_t *store,
                                    const char *space,
                                    const char *schemaName,
                                    avro_value_t **ret_avro_value) {
     int ret;
-    avro_schema_t schema = NULL;
-    avro_value_iface_t *iface = NULL;
+    rkv_schema_entry_t *entry = NULL;
     avro_value_t *avro_value = NULL;
 
-    if (!kvstore || !schemaName || !ret_avro_value) {
+    if (!store || !schemaName || !ret_avro_value) {
         return RKV_INVALID_ARGUEMENTS;
     }
 
-    if ((schema = r_kv_get_schema(kvstore, space, schemaName)) == NULL) {
+    if ((entry = getSchemaEntry(store, space, schemaName)) == NULL) {
         return RKV_INVALID_SCHEMA;
     }
 
     ret = rkv_malloc(sizeof(avro_value_t), (void**)&avro_value);
     RETURN_IF_ERR(ret);
 
-    iface = avro_generic_class_from_schema(schema);
-    if (avro_generic_value_new(iface, avro_value) != 0) {
+    /* The value takes its own reference on the cached class */
+    if (avro_generic_value_new(entry->iface, avro_value) != 0) {
+        free(avro_value);
         return RKV_ERROR;
     }
 
@@ -471,29 +820,120 @@ rkv_error_t r_kv_create_avro_value(kv_store_t *kvstore,
     return RKV_SUCCESS;
 }
 
-avro_schema_t r_kv_get_schema(kv_store_t *kvstore,
+avro_schema_t r_kv_get_schema(rkv_store_t *store,
                              const char *space,
                              const char *name) {
-    int nsch, i;
+    rkv_schema_entry_t *entry = NULL;
+
+    if (!store || !name) {
+        return NULL;
+    }
+    entry = getSchemaEntry(store, space, name);
+    return (entry != NULL) ? entry->schema : NULL;
+}
+
+/*
+ * Drops the cached schemas, the next lookup reads them from the store
+ * again. Avro values already created keep their class alive.
+ */
+void r_kv_invalidate_schemas(rkv_store_t *store) {
+    rkv_schema_cache_t *cache = NULL;
+    int i;
+
+    if (!store) {
+        return;
+    }
+    cache = &store->schemas;
+    for (i = 0; i < cache->nEntries; i++) {
+        free(cache->entries[i].fullName);
+        avro_value_iface_decref(cache->entries[i].iface);
+        avro_schema_decref(cache->entries[i].schema);
+    }
+    cache->nEntries = 0;
+}
+
+/*
+ * Returns the cached entry of the record schema "space.name", the schemas
+ * of the store are only read on a cache miss. The entry is valid until the
+ * next lookup or invalidation.
+ */
+static rkv_schema_entry_t *getSchemaEntry(rkv_store_t *store,
+                                          const char *space,
+                                          const char *name) {
+    rkv_schema_cache_t *cache = &store->schemas;
+    rkv_schema_entry_t *entry = NULL;
     avro_schema_t *schemas = NULL, schema = NULL;
+    const char *schSpace = NULL;
+    char *fullName = NULL;
+    size_t len;
+    int nsch, i;
 
-    if (!kvstore || !name) {
+    if (space != NULL && *space == '\0') {
+        space = NULL;
+    }
+    len = strlen(name) + ((space != NULL) ? strlen(space) + 1 : 0) + 1;
+    if ((fullName = malloc(len)) == NULL) {
         return NULL;
     }
+    if (space != NULL) {
+        snprintf(fullName, len, "%s.%s", space, name);
+    } else {
+        snprintf(fullName, len, "%s", name);
+    }
 
-    schema = avro_schema_record(name, space);
-    nsch = kv_avro_get_current_schemas(kvstore, &schemas);
-    PRINTF("r_kv_get_schema, name = %s, space = %s, nsch = %d\n", name, space, nsch);
+    for (i = 0; i < cache->nEntries; i++) {
+        if (strcmp(cache->entries[i].fullName, fullName) == 0) {
+            free(fullName);
+            return &cache->entries[i];
+        }
+    }
+
+    nsch = kv_avro_get_current_schemas(store->kvstore, &schemas);
+    PRINTF("getSchemaEntry, name = %s, nsch = %d\n", fullName, nsch);
     for (i = 0; i < nsch; i++) {
         avro_schema_t sch = schemas[i];
-        if (avro_typeof(sch) == AVRO_RECORD &&
-            avro_schema_equal(schema, sch)) {
-            avro_schema_decref(schema);
-            return sch;
+        if (avro_typeof(sch) != AVRO_RECORD ||
+            strcmp(avro_schema_name(sch), name) != 0) {
+            continue;
+        }
+        schSpace = avro_schema_namespace(sch);
+        if (schSpace != NULL && *schSpace == '\0') {
+            schSpace = NULL;
         }
+        if ((space == NULL && schSpace == NULL) ||
+            (space != NULL && schSpace != NULL &&
+             strcmp(space, schSpace) == 0)) {
+            schema = sch;
+            break;
+        }
+    }
+    if (schema == NULL) {
+        free(fullName);
+        return NULL;
+    }
+
+    if (cache->nEntries == cache->capacity) {
+        int capacity = (cache->capacity > 0) ? cache->capacity * 2 : 8;
+        rkv_schema_entry_t *entries =
+            realloc(cache->entries, capacity * sizeof(rkv_schema_entry_t));
+        if (entries == NULL) {
+            free(fullName);
+            return NULL;
+        }
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+
+    entry = &cache->entries[cache->nEntries];
+    entry->iface = avro_generic_class_from_schema(schema);
+    if (entry->iface == NULL) {
+        free(fullName);
+        return NULL;
     }
-    avro_schema_decref(schema);
-    return NULL;
+    entry->schema = avro_schema_incref(schema);
+    entry->fullName = fullName;
+    cache->nEntries++;
+    return entry;
 }
 
 void r_kv_release_avro_value(avro_value_t *avro_value) {
@@ -548,7 +988,7 @@ rkv_error_t r_kv_avro_value_get_int(avro_value_t *avro_value,
 
 rkv_error_t r_kv_avro_value_set_long(avro_value_t *avro_value,
                                      const char *name,
-                                     long value) {
+                                     int64_t value) {
     avro_value_t field;
     rkv_error_t ret = RKV_SUCCESS;
 
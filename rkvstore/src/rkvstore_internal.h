@@ -47,14 +47,66 @@
 
 #include <kvstore.h>
 #include "rkverr.h"
+#include "workerpool.h"
+
+/* Number of keys handed to the worker pool at once by the batch APIs */
+#define RKV_BATCH_SIZE      1024
+
+/* Batch size of the key-only iterators that only count the keys */
+#define RKV_COUNT_BATCH_SIZE    10000
+
+/* Large objects are split in chunks, put and got this many at once */
+#define RKV_LOB_CHUNK_SIZE      (512 * 1024)
+#define RKV_LOB_BATCH_SIZE      16
+
+/* Options of the store and multi-get iterators */
+typedef struct rkv_itr_options {
+    int batchSize;              /* 0 for the auto-tuned batch size */
+    kv_depth_t depth;
+    int startInclusive;
+    int endInclusive;
+} rkv_itr_options_t;
+
+/* What an iterator has read, it drives the batch size auto-tuning */
+typedef struct rkv_itr_stats {
+    double nRecords;
+    double nBytes;
+    double nFetches;
+    double fetchSeconds;
+} rkv_itr_stats_t;
+
+/* A resolved record schema and the generic value class built from it */
+typedef struct rkv_schema_entry {
+    char *fullName;             /* "namespace.name" or "name" */
+    avro_schema_t schema;
+    avro_value_iface_t *iface;
+} rkv_schema_entry_t;
+
+typedef struct rkv_schema_cache {
+    rkv_schema_entry_t *entries;
+    int nEntries;
+    int capacity;
+} rkv_schema_cache_t;
+
+typedef struct rkv_store {
+    kv_store_t *kvstore;
+    rkv_pool_t *pool;
+    rkv_schema_cache_t schemas;
+    int compressThreshold;      /* 0 when values are not compressed */
+} rkv_store_t;
 
 /* kvstore - open, close */
 rkv_error_t r_kvstore_open(const char *path,
+                           const char *jvmOptions,
                            const char *storename,
                            const char *host,
                            int port,
-                           kv_store_t ** ret_store);
-rkv_error_t r_kvstore_close(kv_store_t *store);
+                           int nWorkers,
+                           rkv_store_t ** ret_store);
+rkv_error_t r_kvstore_close(rkv_store_t *store);
+rkv_error_t r_kvstore_shutdown(void);
+rkv_error_t r_kv_attach_thread(void);
+void r_kv_detach_thread(void);
 
 /* key - create, get, release */
 rkv_error_t r_kv_create_key(kv_store_t *store,
@@ -75,6 +127,10 @@ rkv_error_t r_kv_create_value_bytes(kv_store_t *store,
                                     kv_value_t **ret_value,
                                     const unsigned char *data,
                                     int data_len);
+rkv_error_t r_kv_wrap_value_bytes(kv_store_t *store,
+                                  kv_value_t **ret_value,
+                                  const unsigned char *data,
+                                  int data_len);
 rkv_error_t r_kv_create_value_avro(kv_store_t *store,
                                    kv_value_t **ret_value,
                                    avro_value_t *avro_value);
@@ -85,6 +141,9 @@ rkv_error_t r_kv_get_value(const kv_value_t *value,
 rkv_error_t r_kv_get_avrovalue(const kv_value_t *value,
                                avro_value_t **ret_avro_value,
                                avro_schema_t schema);
+rkv_error_t r_kv_read_avrovalue(const kv_value_t *value,
+                                avro_value_t *avro_value,
+                                avro_schema_t schema);
 void r_kv_release_value(kv_value_t **value);
 
 /* kvstore: put, get, delete */
@@ -96,29 +155,55 @@ rkv_error_t r_kv_get(kv_store_t *store,
                      const kv_key_t *key,
                      kv_value_t ** ret_value);
 int r_kv_delete(kv_store_t *store, const kv_key_t *key);
+/* kvstore: batched put, get, delete, run on the worker pool if any */
+void r_kv_put_batch(rkv_store_t *store,
+                    kv_key_t **keys,
+                    kv_value_t **values,
+                    rkv_error_t *ret_errs,
+                    int n);
+void r_kv_get_batch(rkv_store_t *store,
+                    kv_key_t **keys,
+                    kv_value_t **ret_values,
+                    rkv_error_t *ret_errs,
+                    int n);
+void r_kv_delete_batch(rkv_store_t *store,
+                       kv_key_t **keys,
+                       int *ret_results,
+                       int n);
 int r_kv_multi_delete(kv_store_t *store,
                      const kv_key_t *parent_key,
                      const char *start,
                      const char *end);
 
 /* kvstore: iterator related operation */
+void r_kv_init_itr_options(rkv_itr_options_t *options);
 rkv_error_t rkv_get_iterator(kv_store_t *store,
                              const kv_key_t *parent_key,
                              kv_iterator_t **return_iterator,
                              const char *start,
                              const char *end,
+                             const rkv_itr_options_t *options,
                              int isKeyOnly,
                              int isMultiGet);
 rkv_error_t r_kv_iterator_size(kv_iterator_t *iterator, int * ret_size);
 rkv_error_t r_kv_iterator_next(kv_iterator_t *iterator,
                                const kv_key_t **ret_key,
                                const kv_value_t **ret_value);
+rkv_error_t r_kv_iterator_next_stats(kv_iterator_t *iterator,
+                                     const kv_key_t **ret_key,
+                                     const kv_value_t **ret_value,
+                                     rkv_itr_stats_t *stats);
+void r_kv_update_itr_tuning(const rkv_itr_stats_t *stats);
+int r_kv_get_itr_batch_size(void);
 void r_kv_release_iterator(kv_iterator_t **iterator);
-avro_schema_t r_kv_get_schema(kv_store_t *kvstore, const char *space,
+
+/* schema cache: lookup, invalidation */
+avro_schema_t r_kv_get_schema(rkv_store_t *store, const char *space,
                              const char *name);
+void r_kv_invalidate_schemas(rkv_store_t *store);
 
 /* AVRO related APIs */
-rkv_error_t r_kv_create_avro_value(kv_store_t *kvstore,
+rkv_error_t r_kv_create_avro_value(rkv_store_t *store,
                                    const char *space,
                                    const char *schemaName,
                                    avro_value_t **ret_avro_value);
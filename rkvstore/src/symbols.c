@@ -49,6 +49,18 @@ SEXP sym_kv_key;
 SEXP sym_kv_value;
 SEXP sym_kv_iterator;
 SEXP sym_kv_avro_value;
+SEXP sym_kv_key_vector;
+SEXP sym_opt_integer64;
+
+SEXP cls_kvstore;
+SEXP cls_kv_key;
+SEXP cls_kv_value;
+SEXP cls_kv_iterator;
+SEXP cls_kv_avro_value;
+SEXP cls_kv_key_vector;
+SEXP cls_integer64;
+
+static SEXP makeClass(const char *name);
 
 void install_kvstore_symbols() {
     sym_kvstore = install("kvstore");
@@ -56,4 +68,24 @@ void install_kvstore_symbols() {
     sym_kv_value = install("kvvalue");
     sym_kv_iterator = install("kviterator");
     sym_kv_avro_value = install("kvavrovalue");
+    sym_kv_key_vector = install("kvkeyvector");
+    sym_opt_integer64 = install("rkvstore.integer64");
+
+    cls_kvstore = makeClass("kvstore");
+    cls_kv_key = makeClass("kvkey");
+    cls_kv_value = makeClass("kvvalue");
+    cls_kv_iterator = makeClass("kviterator");
+    cls_kv_avro_value = makeClass("kvavrovalue");
+    cls_kv_key_vector = makeClass("kvkeyvector");
+    cls_integer64 = makeClass("integer64");
+}
+
+/* Preserved for the session and never modified in place */
+static SEXP makeClass(const char *name) {
+    SEXP cls = allocVector(STRSXP, 1);
+
+    R_PreserveObject(cls);
+    SET_STRING_ELT(cls, 0, mkChar(name));
+    MARK_NOT_MUTABLE(cls);
+    return cls;
 }
@@ -55,5 +55,16 @@ extern SEXP sym_kv_key;
 extern SEXP sym_kv_value;
 extern SEXP sym_kv_iterator;
 extern SEXP sym_kv_avro_value;
+extern SEXP sym_kv_key_vector;
+extern SEXP sym_opt_integer64;
+
+/* The class vectors of the handles, shared by all the objects of a class */
+extern SEXP cls_kvstore;
+extern SEXP cls_kv_key;
+extern SEXP cls_kv_value;
+extern SEXP cls_kv_iterator;
+extern SEXP cls_kv_avro_value;
+extern SEXP cls_kv_key_vector;
+extern SEXP cls_integer64;
 
 #endif
@@ -47,13 +47,22 @@
 static void * getKVObject(SEXP obj, SEXP symbol, const char *cls_name);
 
 kv_store_t *getKVStore(SEXP storeObj) {
-    return (kv_store_t *)getKVObject(storeObj, sym_kvstore, CLASS_KVSTORE);
+    return getRKVStore(storeObj)->kvstore;
+}
+
+rkv_store_t *getRKVStore(SEXP storeObj) {
+    return (rkv_store_t *)getKVObject(storeObj, sym_kvstore, CLASS_KVSTORE);
 }
 
 kv_key_t *getKey(SEXP keyObj) {
     return (kv_key_t *)getKVObject(keyObj, sym_kv_key, CLASS_KV_KEY);
 }
 
+void *getKeyVector(SEXP keysObj) {
+    return (void *)getKVObject(keysObj, sym_kv_key_vector,
+                               CLASS_KV_KEY_VECTOR);
+}
+
 kv_value_t *getValue(SEXP valueObj) {
     return (kv_value_t *)getKVObject(valueObj, sym_kv_value, CLASS_KV_VALUE);
 }
@@ -69,43 +78,49 @@ avro_value_t *getAvroValue(SEXP avroValue) {
 }
 
 static void * getKVObject(SEXP obj, SEXP symbol, const char *cls_name) {
-    SEXP ptr = NULL;
     void *ret = NULL;
 
-    CHECK_OBJ_HAS_CLASS(obj, cls_name);
-    ptr = getAttrib(obj, symbol);
-    if (ptr == R_NilValue) {
-        error("Attribute \"%s\" is missing from the class object\n",
-              cls_name);
-    }
-
-    ret = (void*)R_ExternalPtrAddr(ptr);
+    CHECK_OBJ_IS_KV_OBJECT(obj, symbol, cls_name);
+    ret = R_ExternalPtrAddr(obj);
     if (!ret) {
         error("This \"%s\" object have been destroyed.\n", cls_name);
     }
     return ret;
 }
 
-int checkObjHasClass(SEXP obj, const char *name) {
-    SEXP cls = NULL;
-    int i, len;
+/* Handles are external pointers tagged with the symbol of their type */
+int isKVObject(SEXP obj, SEXP symbol) {
+    return TYPEOF(obj) == EXTPTRSXP && R_ExternalPtrTag(obj) == symbol;
+}
 
-    if (obj == R_NilValue) {
-        return 0;
-    }
+/* A bit64 vector, the 8 bytes of each double are an int64_t */
+int isInteger64(SEXP obj) {
+    return TYPEOF(obj) == REALSXP && inherits(obj, "integer64");
+}
 
-    cls = getAttrib(obj, R_ClassSymbol);
-    if (cls == R_NilValue) {
-        return 0;
-    }
+/* Whether the double converts to an int64_t, NaN doesn't */
+int isInInt64Range(double value) {
+    /* 2^63 is exact as a double, INT64_MAX is not */
+    return value >= -9223372036854775808.0 && value < 9223372036854775808.0;
+}
 
-    len = LENGTH(cls);
-    for (i = 0; i < len; i++) {
-        if (strcmp(CHAR(STRING_ELT(cls, i)), name) == 0) {
-            return 1;
-        }
-    }
-    return 0;
+/* Longs are returned as integer64 with options(rkvstore.integer64=TRUE) */
+int useInteger64(void) {
+    SEXP opt = GetOption1(sym_opt_integer64);
+
+    return isLogical(opt) && LENGTH(opt) == 1 && LOGICAL(opt)[0] == TRUE;
+}
+
+static void checkInterruptFn(void *data) {
+    R_CheckUserInterrupt();
+}
+
+/*
+ * Whether the user pressed Ctrl-C. Unlike R_CheckUserInterrupt, it returns
+ * instead of jumping out, so that the caller releases its resources first.
+ */
+int checkInterrupt(void) {
+    return R_ToplevelExec(checkInterruptFn, NULL) == FALSE;
 }
 
 rkv_error_t rkv_malloc(int size, void **ret) {
@@ -138,9 +153,20 @@ const char *getRKVStoreErrStr(int rc) {
         {RKV_ITR_NO_SIZE_INFO, "No size information for the iterator"},
         {RKV_INVALID_SCHEMA, "Schema doesn't exist"},
         {RKV_INVALID_AVRO_SET_OP, "Failed to set avro value, invalid field type."},
+        {RKV_VALUE_NOT_AVRO, "The value is not an avro value"},
+        {RKV_INVALID_COLUMN_TYPE, "Column type doesn't match the field type"},
+        {RKV_INVALID_COLUMN, "The column is not a supported field of the schema"},
+        {RKV_INVALID_FILTER, "The filter does not match the field types"},
+        {RKV_CORRUPT_VALUE, "The value is truncated or corrupt"},
+        {RKV_VALUE_NOT_LOB, "The value is not a large object manifest"},
+        {RKV_STORES_OPEN, "Stores are still open, close them first"},
+        {RKV_VALUE_OUT_OF_RANGE, "The value is out of the range of the field type"},
+        {RKV_INTERRUPTED, "Interrupted by the user"},
+        {RKV_JVM_SHUT_DOWN, "The JVM was shut down by rkv_shutdown(), restart R to open a store"},
         {RKV_ERROR, "General error"},
         {RKV_NO_MORE_DATA, "No more record"},
         {RKV_KEY_NOT_FOUND, "Can't found the key"},
+        {RKV_FILTERED_OUT, "The record does not match the filter"},
     };
     int i;
     rkv_error_msg_t *err_entry = NULL;
@@ -48,6 +48,7 @@
 #include <kvstore.h>
 
 #include "rkverr.h"
+#include "rkvstore_internal.h"
 
 #ifndef DEBUG
 #define DEBUG 0
@@ -58,6 +59,7 @@
 #define CLASS_KV_VALUE      "kvvalue"
 #define CLASS_KV_ITERATOR   "kviterator"
 #define CLASS_KV_AVRO_VALUE "kvavrovalue"
+#define CLASS_KV_KEY_VECTOR "kvkeyvector"
 
 #define CHECK_IF_VALID_STRING(arg, name)  \
 do { \
@@ -112,9 +114,9 @@ do { \
 #define ERROR_NOT_NULL(name) \
     error("'%s' must be non-null.", name)
 
-#define CHECK_OBJ_HAS_CLASS(obj, name) \
+#define CHECK_OBJ_IS_KV_OBJECT(obj, symbol, name) \
 do { \
-    if (!checkObjHasClass(obj, name)) {\
+    if (!isKVObject(obj, symbol)) {\
         error("This object doesn't has the class %s", name); \
     } \
 }while(0)
@@ -156,6 +158,13 @@ do { \
     } \
 }while(0)
 
+#define ERROR_IF_INTERRUPTED(ret) \
+do { \
+    if (ret == RKV_INTERRUPTED) { \
+        error("%s.", getRKVStoreErrStr(ret)); \
+    } \
+}while(0)
+
 #define PRINT_ERRMSG_IF_ERR(ret) \
 do { \
     if (ret != RKV_SUCCESS) { \
@@ -179,9 +188,15 @@ do { \
     } \
 }while(0)
 
-int checkObjHasClass(SEXP obj, const char *name);
+int isKVObject(SEXP obj, SEXP symbol);
+int isInteger64(SEXP obj);
+int isInInt64Range(double value);
+int useInteger64(void);
+int checkInterrupt(void);
 kv_store_t *getKVStore(SEXP storeObj);
+rkv_store_t *getRKVStore(SEXP storeObj);
 kv_key_t *getKey(SEXP keyObj);
+void *getKeyVector(SEXP keysObj);
 kv_value_t *getValue(SEXP valueObj);
 void *getIterator(SEXP iteratorObj);
 avro_value_t *getAvroValue(SEXP avroValue);
@@ -0,0 +1,226 @@
+/*-
+ *
+ *  This file is part of Oracle NoSQL Database
+ *  Copyright (C) 2011, 2014 Oracle and/or its affiliates.  All rights reserved.
+ *
+ * If you have received this file as part of Oracle NoSQL Database the
+ * following applies to the work as a whole:
+ *
+ *   Oracle NoSQL Database server software is free software: you can
+ *   redistribute it and/or modify it under the terms of the GNU Affero
+ *   General Public License as published by the Free Software Foundation,
+ *   version 3.
+ *
+ *   Oracle NoSQL Database is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Affero General Public License for more details.
+ *
+ * If you have received this file as part of Oracle NoSQL Database Client or
+ * distributed separately the following applies:
+ *
+ *   Oracle NoSQL Database client software is free software: you can
+ *   redistribute it and/or modify it under the terms of the Apache License
+ *   as published by the Apache Software Foundation, version 2.0.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * and/or the Apache License in the LICENSE file along with Oracle NoSQL
+ * Database client or server distribution.  If not, see
+ * <http://www.gnu.org/licenses/>
+ * or
+ * <http://www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An active Oracle commercial licensing agreement for this product supersedes
+ * these licenses and in such case the license notices, but not the copyright
+ * notice, may be removed by you in connection with your distribution that is
+ * in accordance with the commercial licensing terms.
+ *
+ * For more information please contact:
+ *
+ * berkeleydb-info_us@oracle.com
+ *
+ */
+
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "workerpool.h"
+#include "rkvstore_internal.h"
+
+/*
+ * A fixed set of threads that run the tasks of one job at a time. The
+ * tasks must not call into R, they only fill native buffers that are
+ * converted to R objects by the caller once rkv_pool_run() returns.
+ * The workers are attached to the JVM for their whole life, nLive counts
+ * the ones that attached, a worker that fails to attach exits at once.
+ * rkv_pool_create() waits for all of them to attach or fail, so nLive
+ * does not change while a job runs.
+ */
+struct rkv_pool {
+    pthread_t *threads;
+    int nThreads;
+    int nLive;
+    int nStarting;
+    pthread_mutex_t lock;
+    pthread_cond_t workCond;
+    pthread_cond_t doneCond;
+    rkv_task_fn fn;
+    void *ctx;
+    int nTasks;
+    int nextTask;
+    int nBusy;
+    unsigned long generation;
+    int shutdown;
+};
+
+static void *workerMain(void *arg);
+static void runTasks(rkv_pool_t *pool);
+
+rkv_error_t rkv_pool_create(int nWorkers, rkv_pool_t **ret_pool) {
+    rkv_pool_t *pool = NULL;
+    int i;
+
+    if (nWorkers <= 0 || !ret_pool) {
+        return RKV_INVALID_ARGUEMENTS;
+    }
+
+    pool = calloc(1, sizeof(rkv_pool_t));
+    if (pool == NULL) {
+        return RKV_NO_MEMORY;
+    }
+    pool->threads = calloc(nWorkers, sizeof(pthread_t));
+    if (pool->threads == NULL) {
+        free(pool);
+        return RKV_NO_MEMORY;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    for (i = 0; i < nWorkers; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerMain, pool) != 0) {
+            break;
+        }
+        pool->nThreads++;
+        pool->nLive++;
+        pool->nStarting++;
+    }
+    while (pool->nStarting > 0) {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (pool->nLive == 0) {
+        rkv_pool_release(pool);
+        return RKV_ERROR;
+    }
+
+    *ret_pool = pool;
+    return RKV_SUCCESS;
+}
+
+/*
+ * Run tasks 0..nTasks-1 on the workers and wait for all of them. The
+ * calling thread takes tasks as well, so a pool of n workers keeps n + 1
+ * requests in flight.
+ */
+void rkv_pool_run(rkv_pool_t *pool, rkv_task_fn fn, void *ctx, int nTasks) {
+    int i;
+
+    if (nTasks <= 0) {
+        return;
+    }
+    if (pool == NULL) {
+        for (i = 0; i < nTasks; i++) {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->nTasks = nTasks;
+    pool->nextTask = 0;
+    pool->nBusy = pool->nLive;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workCond);
+
+    runTasks(pool);
+    while (pool->nBusy > 0) {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pool->fn = NULL;
+    pool->ctx = NULL;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void rkv_pool_release(rkv_pool_t *pool) {
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nThreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_cond_destroy(&pool->workCond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+static void *workerMain(void *arg) {
+    rkv_pool_t *pool = (rkv_pool_t *)arg;
+    unsigned long seen = 0;
+    int attached = (r_kv_attach_thread() == RKV_SUCCESS);
+
+    pthread_mutex_lock(&pool->lock);
+    if (!attached) {
+        pool->nLive--;
+    }
+    if (--pool->nStarting == 0) {
+        pthread_cond_signal(&pool->doneCond);
+    }
+    if (!attached) {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->workCond, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        runTasks(pool);
+        if (--pool->nBusy == 0) {
+            pthread_cond_signal(&pool->doneCond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    r_kv_detach_thread();
+    return NULL;
+}
+
+/* Called with the pool lock held, the lock is dropped while a task runs. */
+static void runTasks(rkv_pool_t *pool) {
+    while (pool->nextTask < pool->nTasks) {
+        int index = pool->nextTask++;
+        rkv_task_fn fn = pool->fn;
+        void *ctx = pool->ctx;
+
+        pthread_mutex_unlock(&pool->lock);
+        fn(ctx, index);
+        pthread_mutex_lock(&pool->lock);
+    }
+}